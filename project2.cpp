@@ -19,190 +19,6011 @@
 #include <string>
 #include <ctime>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#endif
+
+/*
+ * Allocation counting (built with -DLMS_COUNT_ALLOCATIONS)
+ * Global operator new/delete replacements that count heap allocations on
+ * the calling thread, so the benchmark can report allocations per
+ * operation. The counter is a plain thread-local increment. Without the
+ * flag the standard allocator is left alone and the counter stays zero
+ */
+thread_local uint64_t allocationCount = 0;
+
+#ifdef LMS_COUNT_ALLOCATIONS
+// Kept out of line so GCC does not pair malloc/free with new/delete expressions and warn
+#if defined(__GNUC__)
+#define LMS_NOINLINE __attribute__((noinline))
+#else
+#define LMS_NOINLINE
+#endif
+
+LMS_NOINLINE void* operator new(std::size_t size) {
+    ++allocationCount;
+    if (void* memory = std::malloc(size != 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+LMS_NOINLINE void operator delete(void* memory) noexcept { std::free(memory); }
+LMS_NOINLINE void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+#endif
+
+/*
+ * Metrics Class (built with -DLMS_METRICS)
+ * Operation counts and latency histograms for the hot paths. Every thread
+ * records into its own block of relaxed atomics, so timing an operation
+ * costs two clock reads and two uncontended stores; blocks of finished
+ * threads are kept (and reused) so their counts survive. Histograms are
+ * HDR-style log-linear: 16 linear sub-buckets per power of two of
+ * nanoseconds, so every recorded latency is kept to within 1/16th. The
+ * merged view is exported as Prometheus text, on request or (POSIX) to
+ * stderr whenever the process receives SIGUSR1. Without LMS_METRICS the
+ * LMS_TIME macro expands to nothing and none of this is compiled
+ */
+#ifdef LMS_METRICS
+class Metrics {
+public:
+    enum class Op { Borrow, Return, PayFines, AddBook, RemoveBook, Lookup, Search, Count };
+
+private:
+    static const uint32_t SubBits = 4;
+    static const uint32_t SubBuckets = 1u << SubBits;
+    static const uint32_t Buckets = (64 - SubBits + 1) * SubBuckets;
+
+    struct Histogram {
+        std::atomic<uint64_t> counts[Buckets] = {};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> sum{0};  // Nanoseconds
+    };
+
+    struct Block {
+        Histogram ops[static_cast<size_t>(Op::Count)];
+    };
+
+    // Hands a thread its block, returning it to the free list when the thread exits
+    struct Owner {
+        Block* block = nullptr;
+        ~Owner() {
+            if (block != nullptr) {
+                std::lock_guard<std::mutex> guard(lock());
+                spare().push_back(block);
+            }
+        }
+    };
+
+    static std::mutex& lock() { static std::mutex instance; return instance; }
+    static std::vector<std::unique_ptr<Block>>& blocks() { static std::vector<std::unique_ptr<Block>> instance; return instance; }
+    static std::vector<Block*>& spare() { static std::vector<Block*> instance; return instance; }
+
+    static Block& local() {
+        thread_local Owner owner;
+        if (owner.block == nullptr) {
+            std::lock_guard<std::mutex> guard(lock());
+            if (!spare().empty()) {
+                owner.block = spare().back();
+                spare().pop_back();
+            } else {
+                blocks().emplace_back(new Block);
+                owner.block = blocks().back().get();
+            }
+        }
+        return *owner.block;
+    }
+
+    // Only the owning thread writes, so a relaxed load and store is enough
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static uint32_t bucketOf(uint64_t nanos) {
+        if (nanos < SubBuckets) {
+            return static_cast<uint32_t>(nanos);
+        }
+#if defined(__GNUC__)
+        uint32_t magnitude = 63 - static_cast<uint32_t>(__builtin_clzll(nanos));
+#else
+        uint32_t magnitude = 0;
+        for (uint64_t rest = nanos >> 1; rest != 0; rest >>= 1) {
+            ++magnitude;
+        }
+#endif
+        uint32_t sub = static_cast<uint32_t>(nanos >> (magnitude - SubBits)) & (SubBuckets - 1);
+        return (magnitude - SubBits + 1) * SubBuckets + sub;
+    }
+
+    // Largest latency that falls into bucket
+    static uint64_t upperBound(uint32_t bucket) {
+        if (bucket < SubBuckets) {
+            return bucket;
+        }
+        uint32_t magnitude = bucket / SubBuckets + SubBits - 1;
+        uint64_t sub = bucket % SubBuckets;
+        return ((SubBuckets + sub + 1) << (magnitude - SubBits)) - 1;
+    }
+
+    static const char* name(Op op) {
+        static const char* names[] = {"borrow", "return", "pay_fines", "add_book", "remove_book", "lookup", "search"};
+        return names[static_cast<size_t>(op)];
+    }
+
+public:
+    // Times one operation from construction to destruction
+    class Timer {
+    private:
+        Op op;
+        std::chrono::steady_clock::time_point started;
+
+    public:
+        explicit Timer(Op op) : op(op), started(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            auto elapsed = std::chrono::steady_clock::now() - started;
+            record(op, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    };
+
+    static void record(Op op, uint64_t nanos) {
+        Histogram& histogram = local().ops[static_cast<size_t>(op)];
+        bump(histogram.counts[bucketOf(nanos)], 1);
+        bump(histogram.total, 1);
+        bump(histogram.sum, nanos);
+    }
+
+    // Writes every thread's figures merged, in the Prometheus text exposition format
+    static void writePrometheus(std::ostream& out) {
+        std::lock_guard<std::mutex> guard(lock());
+        out << "# HELP lms_operation_latency_seconds Latency of library operations.\n"
+            << "# TYPE lms_operation_latency_seconds histogram\n";
+        struct Quantile {
+            const char* op;
+            double level;
+            double seconds;
+        };
+        std::vector<uint64_t> merged(Buckets);
+        std::vector<Quantile> quantiles;
+        for (size_t i = 0; i < static_cast<size_t>(Op::Count); ++i) {
+            std::fill(merged.begin(), merged.end(), 0);
+            uint64_t total = 0, sum = 0;
+            for (const std::unique_ptr<Block>& block : blocks()) {
+                const Histogram& histogram = block->ops[i];
+                for (uint32_t b = 0; b < Buckets; ++b) {
+                    merged[b] += histogram.counts[b].load(std::memory_order_relaxed);
+                }
+                total += histogram.total.load(std::memory_order_relaxed);
+                sum += histogram.sum.load(std::memory_order_relaxed);
+            }
+            const char* op = name(static_cast<Op>(i));
+
+            // Cumulative buckets at each power of two from 16 ns to about a minute
+            uint64_t cumulative = 0;
+            uint32_t b = 0;
+            for (uint32_t magnitude = SubBits; magnitude <= 36; ++magnitude) {
+                uint64_t bound = (uint64_t(1) << (magnitude + 1)) - 1;
+                for (; b < Buckets && upperBound(b) <= bound; ++b) {
+                    cumulative += merged[b];
+                }
+                out << "lms_operation_latency_seconds_bucket{op=\"" << op << "\",le=\""
+                    << (bound + 1) / 1e9 << "\"} " << cumulative << "\n";
+            }
+            out << "lms_operation_latency_seconds_bucket{op=\"" << op << "\",le=\"+Inf\"} " << total << "\n"
+                << "lms_operation_latency_seconds_sum{op=\"" << op << "\"} " << sum / 1e9 << "\n"
+                << "lms_operation_latency_seconds_count{op=\"" << op << "\"} " << total << "\n";
+
+            // Percentiles at full histogram resolution
+            static const double levels[] = {0.5, 0.9, 0.99, 0.999};
+            for (double level : levels) {
+                uint64_t rank = static_cast<uint64_t>(std::ceil(level * static_cast<double>(total)));
+                uint64_t seen = 0;
+                uint32_t bucket = 0;
+                while (bucket + 1 < Buckets && (seen += merged[bucket]) < rank) {
+                    ++bucket;
+                }
+                quantiles.push_back(Quantile{op, level, total > 0 ? upperBound(bucket) / 1e9 : 0.0});
+            }
+        }
+        out << "# HELP lms_operation_latency_quantile_seconds Latency percentiles of library operations.\n"
+            << "# TYPE lms_operation_latency_quantile_seconds gauge\n";
+        for (const Quantile& quantile : quantiles) {
+            out << "lms_operation_latency_quantile_seconds{op=\"" << quantile.op << "\",quantile=\""
+                << quantile.level << "\"} " << quantile.seconds << "\n";
+        }
+        out.flush();
+    }
+
+    // Dumps the metrics to stderr on every SIGUSR1. Call before starting other threads:
+    // the signal is blocked in this thread (and so in every thread it starts) and
+    // taken by a dedicated sigwait() thread, so the dump never runs in a signal handler
+    static void dumpOnSignal() {
+#ifndef _WIN32
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        std::thread([signals] {
+            for (;;) {
+                int received = 0;
+                if (sigwait(&signals, &received) == 0) {
+                    writePrometheus(std::cerr);
+                }
+            }
+        }).detach();
+#endif
+    }
+};
+
+#define LMS_METRICS_CONCAT2(a, b) a##b
+#define LMS_METRICS_CONCAT(a, b) LMS_METRICS_CONCAT2(a, b)
+#define LMS_TIME(op) Metrics::Timer LMS_METRICS_CONCAT(metricsTimer, __LINE__)(Metrics::Op::op)
+#else
+#define LMS_TIME(op)
+#endif
 
 // Forward declarations for class dependencies
+class BookHandle;
 class Book;
+class Title;
 class User;
+class Inventory;
+class UserDirectory;
 class Librarian;
+class Snapshot;
+class CatalogView;
+
+/*
+ * BookHandle Class
+ * Compact 32-bit reference to a book slot in the Inventory: the low 24 bits
+ * are the slot index and the high 8 bits its generation. Removing a book
+ * bumps the slot's generation, so old handles resolve to nothing instead of
+ * whichever book reuses the slot
+ */
+class BookHandle {
+private:
+    uint32_t value;  // 0 is never a valid handle (generations start at 1)
+
+public:
+    static const uint32_t IndexBits = 24;
+    static const uint32_t MaxSlots = 1u << IndexBits;
+
+    BookHandle() : value(0) {}
+    BookHandle(uint32_t index, uint32_t generation)
+        : value((generation << IndexBits) | index) {}
+
+    uint32_t getIndex() const { return value & (MaxSlots - 1); }
+    uint32_t getGeneration() const { return value >> IndexBits; }
+    uint32_t getValue() const { return value; }
+    bool isValid() const { return value != 0; }
+
+    static BookHandle fromValue(uint32_t value) {
+        BookHandle handle;
+        handle.value = value;
+        return handle;
+    }
+
+    bool operator==(const BookHandle& other) const { return value == other.value; }
+    bool operator!=(const BookHandle& other) const { return value != other.value; }
+};
+
+/*
+ * Isbn Struct
+ * Parses ISBN-10 and ISBN-13 text (hyphens and spaces ignored, checksum
+ * verified) into a packed 64-bit key: the book's 13 ISBN-13 digits as an
+ * integer, with ISBN-10s converted to their 978- form. Every spelling of
+ * the same ISBN gets the same key, so indexes and comparisons work on an
+ * 8-byte value while the original text is kept only for display
+ */
+struct Isbn {
+    static const uint64_t Invalid = 0;  // Never a valid key: all keys start 978 or 979
+
+    // Key for the 12 leading digits of an ISBN-13, completed with its check digit
+    static uint64_t fromPrefix(uint64_t leading) {
+        uint32_t sum = 0;
+        uint64_t rest = leading;
+        for (int position = 11; position >= 0; --position) {
+            sum += static_cast<uint32_t>(rest % 10) * (position % 2 == 0 ? 1 : 3);
+            rest /= 10;
+        }
+        return leading * 10 + (10 - sum % 10) % 10;
+    }
+
+    // Returns the key for text, or Invalid if it is not a well-formed ISBN
+    static uint64_t parse(std::string_view text) {
+        char digits[13];
+        size_t count = 0;
+        bool endsTen = false;
+        for (char c : text) {
+            if (c == '-' || c == ' ') {
+                continue;
+            }
+            bool isDigit = c >= '0' && c <= '9';
+            bool isTen = (c == 'X' || c == 'x') && count == 9;  // ISBN-10 check digit 10
+            if ((!isDigit && !isTen) || count == 13 || endsTen) {
+                return Invalid;  // Nothing may follow an X, which only ends an ISBN-10
+            }
+            endsTen = isTen;
+            digits[count++] = c;
+        }
+
+        if (count == 10) {
+            uint32_t sum = 0;
+            for (size_t i = 0; i < 10; ++i) {
+                uint32_t value = digits[i] == 'X' || digits[i] == 'x' ? 10 : static_cast<uint32_t>(digits[i] - '0');
+                sum += value * static_cast<uint32_t>(10 - i);
+            }
+            if (sum % 11 != 0) {
+                return Invalid;
+            }
+            uint64_t leading = 978;
+            for (size_t i = 0; i < 9; ++i) {
+                leading = leading * 10 + static_cast<uint64_t>(digits[i] - '0');
+            }
+            return fromPrefix(leading);
+        }
+        if (count != 13) {
+            return Invalid;
+        }
+        uint64_t key = 0;
+        for (size_t i = 0; i < 13; ++i) {
+            key = key * 10 + static_cast<uint64_t>(digits[i] - '0');
+        }
+        uint64_t prefix = key / 10000000000ULL;
+        if ((prefix != 978 && prefix != 979) || fromPrefix(key / 10) != key) {
+            return Invalid;
+        }
+        return key;
+    }
+
+    // 32-bit hash of a key for HashIndex and sharding
+    static uint32_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<uint32_t>(key);
+    }
+};
+
+/*
+ * StatCounter Class
+ * Counter that many threads update without sharing a cache line: each
+ * thread adds into one of Stripes padded slots and a read sums them, so
+ * both are O(1). A read taken while writers are active may miss their
+ * latest adds, but it is exact once they are quiet
+ */
+class StatCounter {
+private:
+    static const size_t Stripes = 16;
+
+    struct alignas(64) Stripe {
+        std::atomic<int64_t> value{0};
+    };
+
+    Stripe stripes[Stripes];
+
+    static size_t stripeOf() {
+        thread_local size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % Stripes;
+        return stripe;
+    }
+
+public:
+    void add(int64_t delta) { stripes[stripeOf()].value.fetch_add(delta, std::memory_order_relaxed); }
+
+    int64_t get() const {
+        int64_t total = 0;
+        for (const Stripe& stripe : stripes) {
+            total += stripe.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+/*
+ * BookColumns Struct
+ * The hot state of one Inventory page of books, stored column-wise:
+ * availability as a bitset and due dates as a contiguous int64 array
+ * (0 while a book is on the shelf or the slot is empty), so counting and
+ * overdue scans touch a few cache lines per thousand books instead of
+ * every Book. Bits are flipped atomically because books sharing a word may
+ * belong to different LibraryService shards
+ */
+struct BookColumns {
+    static const uint32_t Size = 1024;
+
+    std::atomic<uint64_t> available[Size / 64];
+    int64_t dueDates[Size];
+    std::atomic<bool> changed;  // Written since a CatalogView last copied this page
+    StatCounter* shelved;       // The Inventory's count of available books
+
+    BookColumns() : changed(true), shelved(nullptr) {
+        for (std::atomic<uint64_t>& word : available) {
+            word.store(0, std::memory_order_relaxed);
+        }
+        std::fill(std::begin(dueDates), std::end(dueDates), 0);
+    }
+
+    void touch() { changed.store(true, std::memory_order_relaxed); }
+
+    // Number of set bits in a word
+    static uint32_t popcount(uint64_t word) {
+#if defined(__GNUC__)
+        return static_cast<uint32_t>(__builtin_popcountll(word));
+#else
+        uint32_t count = 0;
+        for (; word != 0; word &= word - 1) {
+            ++count;
+        }
+        return count;
+#endif
+    }
+};
+
+/*
+ * Title Class
+ * Shared record of one ISBN: its text, packed key and the copies the
+ * library holds. Copies (Book records) point here instead of carrying the
+ * text themselves. freeCopies lists the copies on the shelf and every copy
+ * remembers its position in it, so taking any available copy and shelving
+ * a returned one are O(1). Patrons waiting for a copy queue in holds,
+ * oldest first, so a returned copy goes to the front of the line in O(1);
+ * the same accounts are kept in a set, so refusing a second hold is O(1)
+ */
+class Title {
+private:
+    std::string_view title;
+    std::string_view author;
+    std::string_view ISBN;          // As entered, for display
+    uint64_t isbnKey;               // Packed ISBN (see Isbn), used for every comparison
+    uint32_t id;                    // Position in the Inventory's title store; never reused
+    std::vector<Book*> copies;      // Every copy, in no particular order
+    std::vector<Book*> freeCopies;  // Copies on the shelf, in no particular order
+    std::deque<uint32_t> holds;     // Accounts waiting for a copy, oldest first
+    std::unordered_set<uint32_t> waiting;  // The same accounts, for the duplicate check
+
+    friend class Inventory;
+    friend class Book;
+
+public:
+    static const uint32_t NoHold = 0xFFFFFFFF;
+
+    // Constructor takes views that must outlive the title (Inventory interns them)
+    Title(std::string_view title, std::string_view author, std::string_view ISBN, uint64_t isbnKey, uint32_t id)
+        : title(title), author(author), ISBN(ISBN), isbnKey(isbnKey), id(id) {}
+
+    std::string_view getTitle() const { return title; }
+    std::string_view getAuthor() const { return author; }
+    std::string_view getISBN() const { return ISBN; }
+    uint64_t getIsbnKey() const { return isbnKey; }
+    uint32_t getId() const { return id; }
+    size_t getCopyCount() const { return copies.size(); }
+    size_t getAvailableCount() const { return freeCopies.size(); }
+    const std::vector<Book*>& getCopies() const { return copies; }
+    const std::deque<uint32_t>& getHolds() const { return holds; }
+    size_t getHoldCount() const { return holds.size(); }
+
+    // The account first in line for a copy, or NoHold if nobody is waiting
+    uint32_t nextHold() const { return holds.empty() ? NoHold : holds.front(); }
+
+    bool isWaiting(uint32_t account) const { return waiting.count(account) != 0; }
+
+    // Position of account in the hold queue (0 is next in line), or NoHold if it is not
+    // waiting; a scan of the queue, for reporting only
+    size_t holdPosition(uint32_t account) const {
+        if (!isWaiting(account)) {
+            return NoHold;
+        }
+        return static_cast<size_t>(std::find(holds.begin(), holds.end(), account) - holds.begin());
+    }
+
+    // Queues account for the next free copy; false if it is already waiting
+    bool addHold(uint32_t account) {
+        if (!waiting.insert(account).second) {
+            return false;
+        }
+        holds.push_back(account);
+        return true;
+    }
+
+    // Drops the hold at the front of the queue
+    void popHold() {
+        waiting.erase(holds.front());
+        holds.pop_front();
+    }
+
+    // Drops every hold
+    void clearHolds() {
+        holds.clear();
+        waiting.clear();
+    }
+
+    // Any copy on the shelf, or nullptr if all are checked out
+    Book* anyAvailable() const { return freeCopies.empty() ? nullptr : freeCopies.back(); }
+
+    // The position'th shelved copy, position < getAvailableCount(); distinct positions are
+    // distinct copies until the shelf changes
+    Book* availableCopy(size_t position) const { return freeCopies[position]; }
+
+    // A copy on the shelf if there is one, otherwise any copy (nullptr once the title is removed)
+    Book* anyCopy() const {
+        return !freeCopies.empty() ? freeCopies.back() : !copies.empty() ? copies.back() : nullptr;
+    }
+};
 
 /*
  * Book Class
- * Represents a book in the library system
+ * One physical copy of a title. The text lives in the shared Title record;
+ * availability and due date are kept in the Inventory's columns, and both
+ * are read through the same accessors as before
  */
 class Book {
 private:
+    Title* record;        // Shared metadata of this copy's ISBN
+    BookColumns* columns; // Page columns holding availability and due date
+    BookHandle handle;    // Slot this book occupies in the Inventory
+    uint32_t copySlot;    // Position of this copy in its title's copy list
+    uint32_t freeSlot;    // Position of this copy in its title's free list, while available
+    uint32_t borrower;    // Account of the user holding the book, while checked out
+    uint32_t loanSlot;    // Position of this book in the borrower's loan list
+    uint32_t loanSerial;  // Loans started on this copy; tells the current loan from earlier ones
+    bool overdueCounted;  // The current loan is in the library's overdue total
+    time_t accruedThrough; // Fines for this loan have been charged up to here
+
+    friend class Inventory;
+    friend class CatalogView;
+
+    // This book's position within its page's columns
+    uint32_t column() const { return handle.getIndex() & (BookColumns::Size - 1); }
+
+public:
+    static const uint32_t NoBorrower = 0xFFFFFFFF;
+
+    // Constructor links the copy to its title; Inventory attaches the columns and shelves it
+    explicit Book(Title* record)
+        : record(record), columns(nullptr), copySlot(0), freeSlot(0),
+          borrower(NoBorrower), loanSlot(0), loanSerial(0), overdueCounted(false),
+          accruedThrough(0) {}
+
+    // Getter methods
+    std::string_view getTitle() const { return record->title; }
+    std::string_view getAuthor() const { return record->author; }
+    std::string_view getISBN() const { return record->ISBN; }
+    uint64_t getIsbnKey() const { return record->isbnKey; }
+    Title* getRecord() const { return record; }
+    bool getAvailability() const {
+        uint32_t bit = column();
+        return (columns->available[bit >> 6].load(std::memory_order_relaxed) >> (bit & 63)) & 1;
+    }
+    time_t getDueDate() const { return static_cast<time_t>(columns->dueDates[column()]); }
+    BookHandle getHandle() const { return handle; }
+    uint32_t getBorrower() const { return borrower; }
+    uint32_t getLoanSlot() const { return loanSlot; }
+    uint32_t getLoanSerial() const { return loanSerial; }
+    bool isOverdueCounted() const { return overdueCounted; }
+    time_t getAccruedThrough() const { return accruedThrough; }
+
+    // Setter methods. Shelving or taking a copy also updates its title's free list,
+    // swapping the last free copy into the vacated position
+    void setAvailability(bool available) {
+        if (available == getAvailability()) {
+            return;
+        }
+        uint32_t bit = column();
+        uint64_t mask = uint64_t(1) << (bit & 63);
+        std::vector<Book*>& shelf = record->freeCopies;
+        columns->touch();
+        columns->shelved->add(available ? 1 : -1);
+        if (available) {
+            columns->available[bit >> 6].fetch_or(mask, std::memory_order_relaxed);
+            freeSlot = static_cast<uint32_t>(shelf.size());
+            shelf.push_back(this);
+        } else {
+            columns->available[bit >> 6].fetch_and(~mask, std::memory_order_relaxed);
+            Book* last = shelf.back();
+            shelf[freeSlot] = last;
+            last->freeSlot = freeSlot;
+            shelf.pop_back();
+        }
+    }
+    void setDueDate(time_t date) {
+        columns->dueDates[column()] = static_cast<int64_t>(date);
+        columns->touch();
+    }
+    void setLoan(uint32_t account, uint32_t slot) {
+        if (account != NoBorrower) {
+            ++loanSerial;  // A new loan, even by the same patron with the same due date
+            overdueCounted = false;
+        }
+        borrower = account;
+        loanSlot = slot;
+        columns->touch();
+    }
+    void setLoanSlot(uint32_t slot) { loanSlot = slot; }
+    void setOverdueCounted(bool counted) { overdueCounted = counted; }
+    void setAccruedThrough(time_t date) { accruedThrough = date; }
+
+    // Appends the displayInfo text to out
+    void appendInfo(std::string& out) const { appendInfo(out, *record, getAvailability()); }
+
+    // The same text for a copy of record, from availability known elsewhere (e.g. a CatalogView)
+    static void appendInfo(std::string& out, const Title& record, bool available) {
+        out.append("Title: ").append(record.getTitle()).append("\nAuthor: ").append(record.getAuthor())
+           .append("\nISBN: ").append(record.getISBN()).append("\nStatus: ")
+           .append(available ? "Available" : "Checked Out").append("\n");
+    }
+
+    // Displays book information
+    void displayInfo() const {
+        std::string text;
+        appendInfo(text);
+        std::cout << text;
+    }
+};
+
+/*
+ * BookRecord Struct
+ * Plain title/author/ISBN triple used for bulk catalog loads
+ */
+struct BookRecord {
     std::string title;
     std::string author;
     std::string ISBN;
-    bool isAvailable;  // Tracks if book is available for checkout
-    time_t dueDate;    // Stores due date if checked out
+};
+
+/*
+ * HashIndex Class
+ * Open-addressing hash table (linear probing, power-of-two size, load
+ * factor at most 1/2, backward-shift deletion so there are no tombstones)
+ * mapping a 32-bit hash to a nonzero 32-bit value. Keys are not stored:
+ * probe() takes a predicate that checks a candidate value against the key,
+ * so an index over strings the records already own holds no copies of them
+ */
+class HashIndex {
+private:
+    struct Bucket {
+        uint32_t value;  // 0 marks an empty bucket
+        uint32_t hash;   // Cached hash, compared before the predicate runs
+    };
+
+    std::vector<Bucket> buckets;
+    size_t count = 0;
+
+    size_t mask() const { return buckets.size() - 1; }
+
+    // Resizes the table to bucketCount (a power of two) and reinserts every entry
+    void rehash(size_t bucketCount) {
+        std::vector<Bucket> old(bucketCount, Bucket{0, 0});
+        old.swap(buckets);
+        for (const Bucket& b : old) {
+            if (b.value != 0) {
+                size_t pos = b.hash & mask();
+                while (buckets[pos].value != 0) {
+                    pos = (pos + 1) & mask();
+                }
+                buckets[pos] = b;
+            }
+        }
+    }
+
+public:
+    HashIndex() { rehash(16); }
+
+    // FNV-1a over bytes, folded to 32 bits
+    static uint32_t hashBytes(const char* bytes, size_t length) {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; ++i) {
+            h ^= static_cast<unsigned char>(bytes[i]);
+            h *= 1099511628211ULL;
+        }
+        return static_cast<uint32_t>(h ^ (h >> 32));
+    }
+
+    static uint32_t hashString(std::string_view text) { return hashBytes(text.data(), text.size()); }
+
+    size_t size() const { return count; }
+
+    // Grows the table so entries fit without further rehashing
+    void reserve(size_t entries) {
+        size_t wanted = buckets.size();
+        while (entries * 2 > wanted) {
+            wanted *= 2;
+        }
+        if (wanted != buckets.size()) {
+            rehash(wanted);
+        }
+    }
+
+    // Returns the bucket whose value satisfies matches(value), or the empty bucket where that key would go
+    template <typename Match>
+    size_t probe(uint32_t hash, Match matches) const {
+        size_t pos = hash & mask();
+        while (buckets[pos].value != 0) {
+            const Bucket& b = buckets[pos];
+            if (b.hash == hash && matches(b.value)) {
+                break;
+            }
+            pos = (pos + 1) & mask();
+        }
+        return pos;
+    }
+
+    bool occupied(size_t pos) const { return buckets[pos].value != 0; }
+    uint32_t value(size_t pos) const { return buckets[pos].value; }
+
+    // Fills the empty bucket returned by probe(); call reserve(size() + 1) before probing
+    void insert(size_t pos, uint32_t value, uint32_t hash) {
+        buckets[pos] = Bucket{value, hash};
+        ++count;
+    }
+
+    // Empties a bucket, shifting later entries of the probe run back into the gap
+    void erase(size_t pos) {
+        size_t next = (pos + 1) & mask();
+        while (buckets[next].value != 0) {
+            size_t ideal = buckets[next].hash & mask();
+            // Move the entry back if its ideal bucket is not in (pos, next]
+            if (((next - ideal) & mask()) >= ((next - pos) & mask())) {
+                buckets[pos] = buckets[next];
+                pos = next;
+            }
+            next = (next + 1) & mask();
+        }
+        buckets[pos] = Bucket{0, 0};
+        --count;
+    }
+};
+
+/*
+ * StringArena Class
+ * Append-only store for the text of books and users. Strings are copied
+ * into 64 KiB chunks that never move, so the string_views handed out stay
+ * valid for the arena's lifetime. intern() also deduplicates through a
+ * HashIndex, so repeated text such as an author shared by many books is
+ * stored once; copy() skips that for text known to be unique. Nothing is
+ * freed before the arena itself, so the text of removed books stays behind
+ * until the library is reloaded
+ */
+class StringArena {
+private:
+    static const size_t ChunkBytes = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* cursor = nullptr;              // Free space in the current chunk
+    size_t remaining = 0;
+    std::vector<std::string_view> interned;  // Deduplicated strings; index values are positions plus one
+    HashIndex index;
+    size_t bytes = 0;
+
+    char* allocate(size_t size) {
+        bytes += size;
+        if (size > ChunkBytes / 4) {
+            // Oversized text gets a chunk of its own, leaving the current one in use
+            chunks.emplace_back(new char[size]);
+            return chunks.back().get();
+        }
+        if (size > remaining) {
+            chunks.emplace_back(new char[ChunkBytes]);
+            cursor = chunks.back().get();
+            remaining = ChunkBytes;
+        }
+        char* at = cursor;
+        cursor += size;
+        remaining -= size;
+        return at;
+    }
+
+public:
+    StringArena() = default;
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    // Stores text without deduplication
+    std::string_view copy(std::string_view text) {
+        if (text.empty()) {
+            return std::string_view();
+        }
+        char* at = allocate(text.size());
+        std::memcpy(at, text.data(), text.size());
+        return std::string_view(at, text.size());
+    }
+
+    // Returns the stored copy of text, storing it first if it is new
+    std::string_view intern(std::string_view text) {
+        if (text.empty()) {
+            return std::string_view();
+        }
+        index.reserve(index.size() + 1);
+        uint32_t hash = HashIndex::hashString(text);
+        size_t pos = index.probe(hash, [this, text](uint32_t value) { return interned[value - 1] == text; });
+        if (index.occupied(pos)) {
+            return interned[index.value(pos) - 1];
+        }
+        std::string_view stored = copy(text);
+        interned.push_back(stored);
+        index.insert(pos, static_cast<uint32_t>(interned.size()), hash);
+        return stored;
+    }
+
+    size_t storedBytes() const { return bytes; }
+};
+
+/*
+ * SearchIndex Class
+ * Inverted index from case-folded title and author words to the titles
+ * that contain them. Posting lists are found through a hash map; a sorted
+ * view of the same words serves prefix terms as a range scan. Each posting
+ * is a vector of title ids appended to as titles arrive and sorted lazily
+ * when it is next read. Removed titles are not erased from their postings:
+ * their ids stop resolving and the entries are dropped at that next read.
+ * A query is driven by its most selective term, and the candidates are
+ * checked against the other terms
+ */
+class SearchIndex {
+private:
+    struct Posting {
+        std::vector<uint32_t> books;  // Title ids
+        bool dirty = false;           // Unsorted, or holds removed titles
+    };
+
+    std::unordered_map<std::string, Posting> words;
+    std::map<std::string_view, Posting*> ordered;  // Views of the keys above, for prefix scans
+    std::vector<uint32_t> seen;                    // Per-title query stamp, to deduplicate prefix matches
+    uint32_t stamp = 0;
+
+    // Sorts a posting and drops the ids that no longer resolve
+    template <typename Resolve>
+    static const std::vector<uint32_t>& settle(Posting& posting, const Resolve& resolve) {
+        if (posting.dirty) {
+            std::vector<uint32_t>& books = posting.books;
+            std::sort(books.begin(), books.end());
+            books.erase(std::unique(books.begin(), books.end()), books.end());
+            books.erase(std::remove_if(books.begin(), books.end(),
+                                       [&resolve](uint32_t value) { return resolve(value) == nullptr; }),
+                        books.end());
+            posting.dirty = false;
+        }
+        return posting.books;
+    }
+
+    // One query term: an exact word's posting, or the range of words a prefix covers
+    struct Term {
+        const std::vector<uint32_t>* books = nullptr;  // Exact terms
+        std::string prefix;                            // Prefix terms
+        std::map<std::string_view, Posting*>::iterator first, last;
+        size_t size = 0;                               // Postings to scan (an upper bound for prefixes)
+    };
+
+    static bool hasWordWithPrefix(std::string_view text, const std::string& prefix,
+                                  std::vector<std::string>& scratch) {
+        scratch.clear();
+        tokenize(text, scratch);
+        for (const std::string& word : scratch) {
+            if (word.compare(0, prefix.size(), prefix) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    // Appends the lowercase alphanumeric words of text to out
+    static void tokenize(std::string_view text, std::vector<std::string>& out) {
+        std::string word;
+        for (char c : text) {
+            if (std::isalnum(static_cast<unsigned char>(c))) {
+                word += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            } else if (!word.empty()) {
+                out.push_back(word);
+                word.clear();
+            }
+        }
+        if (!word.empty()) {
+            out.push_back(word);
+        }
+    }
+
+    // Indexes a new title under every distinct word of its title and author
+    void add(uint32_t id, std::string_view title, std::string_view author) {
+        std::vector<std::string> tokens;
+        tokenize(title, tokens);
+        tokenize(author, tokens);
+        std::sort(tokens.begin(), tokens.end());
+        tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+        for (std::string& token : tokens) {
+            auto found = words.find(token);
+            if (found == words.end()) {
+                found = words.emplace(std::move(token), Posting()).first;
+                ordered.emplace(std::string_view(found->first), &found->second);
+            }
+            Posting& posting = found->second;
+            if (!posting.books.empty() && posting.books.back() >= id) {
+                posting.dirty = true;
+            }
+            posting.books.push_back(id);
+        }
+    }
+
+    // Marks the postings of a title being removed for cleanup on their next read
+    void remove(std::string_view title, std::string_view author) {
+        std::vector<std::string> tokens;
+        tokenize(title, tokens);
+        tokenize(author, tokens);
+        for (const std::string& token : tokens) {
+            auto found = words.find(token);
+            if (found != words.end()) {
+                found->second.dirty = true;
+            }
+        }
+    }
+
+    // Marks the postings of many removed titles at once, given their titles and authors.
+    // Interned texts repeat as the same view and are tokenized once, and each distinct
+    // word is looked up once for the whole batch. Reorders texts
+    void remove(std::vector<std::string_view>& texts) {
+        std::sort(texts.begin(), texts.end(), [](std::string_view a, std::string_view b) {
+            return a.data() != b.data() ? a.data() < b.data() : a.size() < b.size();
+        });
+        std::vector<std::string> tokens;
+        for (size_t i = 0; i < texts.size(); ++i) {
+            if (i == 0 || texts[i].data() != texts[i - 1].data() || texts[i].size() != texts[i - 1].size()) {
+                tokenize(texts[i], tokens);
+            }
+        }
+        std::sort(tokens.begin(), tokens.end());
+        tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+        for (const std::string& token : tokens) {
+            auto found = words.find(token);
+            if (found != words.end()) {
+                found->second.dirty = true;
+            }
+        }
+    }
+
+    // Finds the titles matching every term of text; a term ending in '*' matches
+    // any word it prefixes. resolve(id) returns the live Title or nullptr. Appends up
+    // to limit matches to out and returns the total count
+    template <typename Resolve>
+    size_t query(const std::string& text, const Resolve& resolve, size_t limit, std::vector<uint32_t>& out) {
+        std::vector<Term> terms;
+        std::vector<std::string> tokens;
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find_first_of(" \t", start);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            bool prefix = end > start && text[end - 1] == '*';
+            tokens.clear();
+            tokenize(std::string_view(text).substr(start, end - start), tokens);
+            start = end + 1;
+
+            for (size_t i = 0; i < tokens.size(); ++i) {
+                Term term;
+                if (prefix && i + 1 == tokens.size()) {
+                    term.prefix = tokens[i];
+                    term.first = ordered.lower_bound(term.prefix);
+                    term.last = term.first;
+                    while (term.last != ordered.end() && term.last->first.compare(0, term.prefix.size(), term.prefix) == 0) {
+                        term.size += settle(*term.last->second, resolve).size();
+                        ++term.last;
+                    }
+                } else {
+                    auto found = words.find(tokens[i]);
+                    if (found == words.end()) {
+                        return 0;
+                    }
+                    term.books = &settle(found->second, resolve);
+                    term.size = term.books->size();
+                }
+                if (term.size == 0) {
+                    return 0;
+                }
+                terms.push_back(std::move(term));
+            }
+        }
+        if (terms.empty()) {
+            return 0;
+        }
+
+        // The smallest term generates candidates; the rest filter them
+        std::sort(terms.begin(), terms.end(), [](const Term& a, const Term& b) { return a.size < b.size; });
+        std::vector<uint32_t> candidates;
+        if (terms[0].books == nullptr) {
+            // A title can carry several words with the prefix; stamp it to count it once
+            if (++stamp == 0) {
+                std::fill(seen.begin(), seen.end(), 0);
+                stamp = 1;
+            }
+            for (auto it = terms[0].first; it != terms[0].last; ++it) {
+                for (uint32_t value : it->second->books) {
+                    if (value >= seen.size()) {
+                        seen.resize(value + 1, 0);
+                    }
+                    if (seen[value] != stamp) {
+                        seen[value] = stamp;
+                        candidates.push_back(value);
+                    }
+                }
+            }
+        }
+        const std::vector<uint32_t>& driver = terms[0].books != nullptr ? *terms[0].books : candidates;
+
+        size_t total = 0;
+        std::vector<std::string> scratch;
+        for (uint32_t value : driver) {
+            bool all = true;
+            for (size_t i = 1; i < terms.size() && all; ++i) {
+                if (terms[i].books != nullptr) {
+                    all = std::binary_search(terms[i].books->begin(), terms[i].books->end(), value);
+                } else {
+                    const Title* title = resolve(value);
+                    all = hasWordWithPrefix(title->getTitle(), terms[i].prefix, scratch) ||
+                          hasWordWithPrefix(title->getAuthor(), terms[i].prefix, scratch);
+                }
+            }
+            if (all) {
+                if (total < limit) {
+                    out.push_back(value);
+                }
+                ++total;
+            }
+        }
+        return total;
+    }
+};
+
+/*
+ * Inventory Class
+ * Owns all books in the library: one shared Title record per ISBN and one
+ * Book record per physical copy. Copies live in a paged slab that never
+ * moves them, so a BookHandle (or Book*) stays valid while the inventory
+ * grows and shrinks; freed slots are recycled through a free list. An
+ * open-addressing hash index maps ISBN key to title, so lookup, insertion
+ * and removal by ISBN are O(1); a SearchIndex over titles and authors is
+ * kept up to date alongside it. A title is retired when its last copy goes
+ */
+class Inventory {
+private:
+    static const uint32_t PageBits = 10;
+    static const uint32_t PageSize = 1u << PageBits;
+    static const uint32_t NoSlot = 0xFFFFFFFF;
+
+    static_assert(PageSize == BookColumns::Size, "book columns must cover one page");
+
+    // One slab slot; link is the next free slot while empty, the book's position in order while live
+    struct Slot {
+        std::optional<Book> book;
+        uint32_t generation = 1;
+        uint32_t link = NoSlot;
+    };
+
+    // Books of one page, and the columns of their hot state
+    struct Page {
+        Slot slots[PageSize];
+        BookColumns columns;
+    };
+
+    std::vector<std::unique_ptr<Page>> pages;
+    uint32_t slotCount = 0;        // Slots handed out so far, live or free
+    uint32_t freeHead = NoSlot;    // Most recently freed slot
+    std::vector<BookHandle> order; // Live copies, densely packed for positional access
+    std::deque<Title> titles;      // Every title ever added; ids are positions and are never reused
+    size_t liveTitles = 0;
+    HashIndex isbnIndex;           // ISBN key -> title id plus one
+    SearchIndex searchIndex;       // Title and author words -> title ids
+    StringArena text;              // Titles and authors (interned) and ISBNs
+
+    friend class CatalogView;
+
+    StatCounter shelved;           // Books on the shelf, kept by Book::setAvailability
+
+    // Appends an empty page whose columns report to the shelved count
+    void addPage() {
+        pages.emplace_back(new Page);
+        pages.back()->columns.shelved = &shelved;
+    }
+
+    Slot& slotAt(uint32_t index) { return pages[index >> PageBits]->slots[index & (PageSize - 1)]; }
+    const Slot& slotAt(uint32_t index) const { return pages[index >> PageBits]->slots[index & (PageSize - 1)]; }
+
+    // Returns the isbnIndex bucket holding key, or the empty bucket where it would go
+    size_t probe(uint64_t key) const {
+        return isbnIndex.probe(Isbn::hash(key), [this, key](uint32_t value) {
+            return titles[value - 1].isbnKey == key;
+        });
+    }
+
+    // Creates the title for key at its (empty) isbnIndex bucket pos
+    Title& createTitle(size_t pos, std::string_view title, std::string_view author,
+                       std::string_view ISBN, uint64_t key) {
+        uint32_t id = static_cast<uint32_t>(titles.size());
+        titles.emplace_back(text.intern(title), text.intern(author), text.copy(ISBN), key, id);
+        isbnIndex.insert(pos, id + 1, Isbn::hash(key));
+        searchIndex.add(id, title, author);
+        ++liveTitles;
+        return titles.back();
+    }
+
+    // Constructs a copy of record in an empty slot, attached to its page's columns and
+    // shelved, and appends it to the positional order
+    Book& placeCopy(uint32_t index, BookHandle handle, Title& record) {
+        Slot& slot = slotAt(index);
+        slot.book.emplace(&record);
+        Book& book = *slot.book;
+        book.columns = &pages[index >> PageBits]->columns;
+        book.handle = handle;
+        book.copySlot = static_cast<uint32_t>(record.copies.size());
+        record.copies.push_back(&book);
+        book.setDueDate(0);
+        book.setAvailability(true);
+        slot.link = static_cast<uint32_t>(order.size());
+        order.push_back(handle);
+        return book;
+    }
+
+    // Takes a slot from the free list, or a fresh one from the last page
+    uint32_t allocateSlot() {
+        if (freeHead != NoSlot) {
+            uint32_t index = freeHead;
+            freeHead = slotAt(index).link;
+            return index;
+        }
+        if (slotCount == BookHandle::MaxSlots) {
+            return NoSlot;
+        }
+        if ((slotCount & (PageSize - 1)) == 0) {
+            addPage();
+        }
+        return slotCount++;
+    }
+
+    // Destroys the slot's copy, retiring its title if it was the last one,
+    // invalidates outstanding handles and recycles the slot. A retired title's
+    // words are unindexed here, or left in retired for one batched update
+    void releaseSlot(uint32_t index, std::vector<std::string_view>* retired = nullptr) {
+        Slot& slot = slotAt(index);
+        Book& book = *slot.book;
+        book.setAvailability(false);
+        book.setDueDate(0);
+
+        Title& record = *book.record;
+        Book* last = record.copies.back();
+        record.copies[book.copySlot] = last;
+        last->copySlot = book.copySlot;
+        record.copies.pop_back();
+        if (record.copies.empty()) {
+            record.clearHolds();  // Nothing left to wait for
+            isbnIndex.erase(probe(record.isbnKey));
+            if (retired != nullptr) {
+                retired->push_back(record.title);
+                retired->push_back(record.author);
+            } else {
+                searchIndex.remove(record.title, record.author);
+            }
+            --liveTitles;
+        }
+
+        slot.book.reset();
+        slot.generation = (slot.generation + 1) & 0xFF;
+        if (slot.generation == 0) {
+            slot.generation = 1;
+        }
+        slot.link = freeHead;
+        freeHead = index;
+    }
+
+public:
+    // Iterates live books in positional order
+    class const_iterator {
+    private:
+        const Inventory* inventory;
+        size_t position;
+
+    public:
+        const_iterator(const Inventory* inventory, size_t position)
+            : inventory(inventory), position(position) {}
+        const Book& operator*() const { return (*inventory)[position]; }
+        const Book* operator->() const { return &(*inventory)[position]; }
+        const_iterator& operator++() { ++position; return *this; }
+        bool operator!=(const const_iterator& other) const { return position != other.position; }
+    };
+
+    Inventory() = default;
+    Inventory(const Inventory&) = delete;
+    Inventory& operator=(const Inventory&) = delete;
+
+    // Container-style access to copies by position; positions change when copies are removed, handles do not
+    size_t size() const { return order.size(); }
+    bool empty() const { return order.empty(); }
+    Book& operator[](size_t position) { return *slotAt(order[position].getIndex()).book; }
+    const Book& operator[](size_t position) const { return *slotAt(order[position].getIndex()).book; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, order.size()); }
+
+    // Number of distinct ISBNs held
+    size_t titleCount() const { return liveTitles; }
+
+    // Resolves a handle, or returns nullptr if the book has since been removed
+    Book* get(BookHandle handle) {
+        uint32_t index = handle.getIndex();
+        if (!handle.isValid() || index >= slotCount) {
+            return nullptr;
+        }
+        Slot& slot = slotAt(index);
+        return slot.book && slot.generation == handle.getGeneration() ? &*slot.book : nullptr;
+    }
+
+    const Book* get(BookHandle handle) const {
+        return const_cast<Inventory*>(this)->get(handle);
+    }
+
+    // Resolves a title id, or returns nullptr once the title has been retired
+    Title* getTitle(uint32_t id) {
+        return id < titles.size() && !titles[id].copies.empty() ? &titles[id] : nullptr;
+    }
+
+    // Finds the title with a packed ISBN key, or returns nullptr
+    Title* findTitleKey(uint64_t key) {
+        LMS_TIME(Lookup);
+        if (key == Isbn::Invalid) {
+            return nullptr;
+        }
+        size_t pos = probe(key);
+        return isbnIndex.occupied(pos) ? &titles[isbnIndex.value(pos) - 1] : nullptr;
+    }
+
+    Title* findTitle(std::string_view ISBN) { return findTitleKey(Isbn::parse(ISBN)); }
+
+    // Whether a packed ISBN key is held; reads only, so import checks can run it from many threads
+    bool contains(uint64_t key) const { return key != Isbn::Invalid && isbnIndex.occupied(probe(key)); }
+
+    // Finds a copy by ISBN: one on the shelf if any is, otherwise any copy; nullptr if not held
+    Book* find(std::string_view ISBN) { return findKey(Isbn::parse(ISBN)); }
+
+    const Book* find(std::string_view ISBN) const {
+        return const_cast<Inventory*>(this)->find(ISBN);
+    }
+
+    Book* findKey(uint64_t key) {
+        Title* record = findTitleKey(key);
+        return record != nullptr ? record->anyCopy() : nullptr;
+    }
+
+    // Books on the shelf, in O(1) from the running count
+    size_t availableCount() const { return static_cast<size_t>(shelved.get()); }
+
+    // Books on the shelf, counted over the availability bitsets
+    size_t countAvailable() const {
+        size_t count = 0;
+        for (const std::unique_ptr<Page>& page : pages) {
+            for (const std::atomic<uint64_t>& word : page->columns.available) {
+                count += BookColumns::popcount(word.load(std::memory_order_relaxed));
+            }
+        }
+        return count;
+    }
+
+    // Loans due before now, counted over the due-date columns (0 marks no loan)
+    size_t countOverdue(time_t now) const {
+        // Counts due - 1 < now - 1 (unsigned, so 0 wraps and never counts) through the
+        // borrow bit of the subtraction: SSE2 has no 64-bit compare, but this vectorizes
+        const uint64_t end = static_cast<uint64_t>(now) - 1;
+        size_t count = 0;
+        for (const std::unique_ptr<Page>& page : pages) {
+            const int64_t* due = page->columns.dueDates;
+            uint64_t pageCount = 0;
+            for (uint32_t i = 0; i < PageSize; ++i) {
+                uint64_t x = static_cast<uint64_t>(due[i]) - 1;
+                pageCount += ((~x & end) | (~(x ^ end) & (x - end))) >> 63;
+            }
+            count += pageCount;
+        }
+        return count;
+    }
+
+    // Calls visit(book) for every loan due before now, skipping pages with none
+    template <typename Visit>
+    void forEachOverdue(time_t now, Visit visit) {
+        const int64_t end = static_cast<int64_t>(now);
+        for (size_t p = 0; p < pages.size(); ++p) {
+            const int64_t* due = pages[p]->columns.dueDates;
+            for (uint32_t i = 0; i < PageSize; ++i) {
+                if ((due[i] != 0) & (due[i] < end)) {
+                    visit(*pages[p]->slots[i].book);
+                }
+            }
+        }
+    }
+
+    // Title/author search (see SearchIndex::query); appends up to limit matching titles, returns the total
+    size_t search(const std::string& query, size_t limit, std::vector<Title*>& matches) {
+        std::vector<uint32_t> ids;
+        size_t total = searchIndex.query(query, [this](uint32_t id) { return getTitle(id); }, limit, ids);
+        for (uint32_t id : ids) {
+            matches.push_back(&titles[id]);
+        }
+        return total;
+    }
+
+    // Places a copy at a specific handle, used when reloading persisted state;
+    // it joins the title of its ISBN, creating it if needed. Fails if the slot
+    // is taken or the ISBN is invalid; call rebuildFreeList() once all books
+    // have been restored. key may be passed when it is already known (e.g.
+    // from a snapshot) to skip parsing
+    Book* restore(BookHandle handle, const std::string& title, const std::string& author,
+                  const std::string& ISBN, uint64_t key = Isbn::Invalid) {
+        uint32_t index = handle.getIndex();
+        if (key == Isbn::Invalid) {
+            key = Isbn::parse(ISBN);
+        }
+        if (!handle.isValid() || key == Isbn::Invalid || (index < slotCount && slotAt(index).book)) {
+            return nullptr;
+        }
+        isbnIndex.reserve(isbnIndex.size() + 1);
+        size_t pos = probe(key);
+        Title& record = isbnIndex.occupied(pos) ? titles[isbnIndex.value(pos) - 1]
+                                                : createTitle(pos, title, author, ISBN, key);
+        while (pages.size() * PageSize <= index) {
+            addPage();
+        }
+        slotCount = std::max(slotCount, index + 1);
+
+        slotAt(index).generation = handle.getGeneration();
+        return &placeCopy(index, handle, record);
+    }
+
+    // Chains every unused slot below slotCount into the free list
+    void rebuildFreeList() {
+        freeHead = NoSlot;
+        for (uint32_t index = slotCount; index-- > 0;) {
+            Slot& slot = slotAt(index);
+            if (!slot.book) {
+                slot.link = freeHead;
+                freeHead = index;
+            }
+        }
+    }
+
+    // Pre-sizes the slab, positional list and index for count books in total
+    void reserve(size_t count) {
+        if (count > BookHandle::MaxSlots) {
+            count = BookHandle::MaxSlots;
+        }
+        order.reserve(count);
+        pages.reserve((count + PageSize - 1) / PageSize);
+        isbnIndex.reserve(count);
+    }
+
+    // Adds a range of BookRecords as new titles with one copy each, reserving
+    // once up front. Records whose ISBN is invalid or already present (in the
+    // inventory or earlier in the range) are skipped. Returns the number added
+    template <typename Iterator>
+    size_t addAll(Iterator first, Iterator last) {
+        size_t start = order.size();
+        reserve(start + static_cast<size_t>(std::distance(first, last)));
+
+        for (; first != last; ++first) {
+            uint64_t key = Isbn::parse(first->ISBN);
+            if (key == Isbn::Invalid) {
+                continue;
+            }
+            size_t pos = probe(key);
+            if (isbnIndex.occupied(pos)) {
+                continue;
+            }
+            uint32_t index = allocateSlot();
+            if (index == NoSlot) {
+                break;
+            }
+            Title& record = createTitle(pos, first->title, first->author, first->ISBN, key);
+            placeCopy(index, BookHandle(index, slotAt(index).generation), record);
+        }
+        return order.size() - start;
+    }
+
+    // Adds a copy: a new title if the ISBN is new, otherwise another copy of the
+    // existing one (whose text is kept). Returns an invalid handle if the ISBN is
+    // invalid or the slab is full
+    BookHandle add(const std::string& title, const std::string& author, const std::string& ISBN) {
+        uint64_t key = Isbn::parse(ISBN);
+        if (key == Isbn::Invalid) {
+            return BookHandle();
+        }
+        isbnIndex.reserve(isbnIndex.size() + 1);
+        size_t pos = probe(key);
+        uint32_t index = allocateSlot();
+        if (index == NoSlot) {
+            return BookHandle();
+        }
+        Title& record = isbnIndex.occupied(pos) ? titles[isbnIndex.value(pos) - 1]
+                                                : createTitle(pos, title, author, ISBN, key);
+        BookHandle handle(index, slotAt(index).generation);
+        placeCopy(index, handle, record);
+        return handle;
+    }
+
+    // Removes one copy; the last copy in positional order takes its position
+    bool removeCopy(BookHandle handle) {
+        if (get(handle) == nullptr) {
+            return false;
+        }
+        uint32_t index = handle.getIndex();
+        uint32_t position = slotAt(index).link;
+        BookHandle last = order.back();
+        order[position] = last;
+        slotAt(last.getIndex()).link = position;
+        order.pop_back();
+
+        releaseSlot(index);
+        return true;
+    }
+
+    // Removes many copies at once. Unlike removeCopy, the positional order is compacted
+    // in one pass from the first removed position, so the remaining copies keep their
+    // relative order and the cost is O(n) for the whole batch rather than per copy; the
+    // search index is updated once for all the titles retired. Handles that no longer
+    // resolve, and repeats, are skipped; removed receives the handles actually removed
+    // (now invalid). Returns their number
+    size_t removeCopies(const std::vector<BookHandle>& handles, std::vector<BookHandle>& removed) {
+        removed.clear();
+        size_t first = order.size();
+        for (BookHandle handle : handles) {
+            if (get(handle) == nullptr) {
+                continue;
+            }
+            Slot& slot = slotAt(handle.getIndex());
+            if (slot.link == NoSlot) {
+                continue;  // Listed twice
+            }
+            first = std::min(first, static_cast<size_t>(slot.link));
+            slot.link = NoSlot;  // Marks the copy for the compaction pass
+            removed.push_back(handle);
+        }
+        size_t kept = first;
+        for (size_t position = first; position < order.size(); ++position) {
+            Slot& slot = slotAt(order[position].getIndex());
+            if (slot.link != NoSlot) {
+                slot.link = static_cast<uint32_t>(kept);
+                order[kept++] = order[position];
+            }
+        }
+        order.resize(kept);
+
+        std::vector<std::string_view> retired;
+        for (BookHandle handle : removed) {
+            releaseSlot(handle.getIndex(), &retired);
+        }
+        searchIndex.remove(retired);
+        return removed.size();
+    }
+
+    // Removes every shelved copy of each ISBN in one compaction pass (see removeCopies);
+    // checked-out copies stay, so no loan is stranded. missing receives the number of
+    // ISBNs that are invalid or not held
+    size_t removeAll(const std::vector<std::string>& ISBNs, std::vector<BookHandle>& removed, size_t& missing) {
+        std::vector<BookHandle> handles;
+        missing = 0;
+        for (const std::string& ISBN : ISBNs) {
+            Title* record = findTitle(ISBN);
+            if (record == nullptr) {
+                ++missing;
+                continue;
+            }
+            for (const Book* book : record->freeCopies) {
+                handles.push_back(book->getHandle());
+            }
+        }
+        return removeCopies(handles, removed);
+    }
+
+    // Removes one copy of ISBN that is on the shelf; false if none is
+    bool remove(std::string_view ISBN) {
+        Title* record = findTitle(ISBN);
+        Book* book = record != nullptr ? record->anyAvailable() : nullptr;
+        return book != nullptr && removeCopy(book->getHandle());
+    }
+};
+
+// Outcome of a circulation operation, for callers that report it themselves
+enum class LoanResult {
+    Ok,
+    NotAvailable,  // Book is checked out
+    NotBorrowed,   // User does not hold the book
+    Overpaid,      // Payment exceeds owed fines
+    InvalidAmount, // Payment is negative
+    NoSuchUser,    // userID is not registered
+    NoSuchBook,    // ISBN is not in the inventory
+    AlreadyWaiting // User is already in the title's hold queue
+};
+
+// Formats an amount of cents as dollars with two decimals, e.g. 1234 -> "12.34"
+std::string formatCents(int64_t cents) {
+    std::string sign = cents < 0 ? "-" : "";
+    uint64_t magnitude = cents < 0 ? 0 - static_cast<uint64_t>(cents) : static_cast<uint64_t>(cents);
+    std::string fraction = std::to_string(magnitude % 100);
+    return sign + std::to_string(magnitude / 100) + (fraction.size() < 2 ? ".0" : ".") + fraction;
+}
+
+/*
+ * Loan Policies
+ * A policy sets how long a loan runs (loanSeconds) and what lateness
+ * costs: once graceSeconds past the due date, centsPerPeriod for every
+ * complete period of periodSeconds, up to capCents per loan (0 for no
+ * cap). FixedLoanPolicy carries these as compile-time constants, so the
+ * User circulation cores instantiated with it fold them into the code;
+ * LoanPolicy holds the same fields at run time, and LoanPolicyTable keeps
+ * one per patron class for branches with different rules. The cores are
+ * templates over either kind and read the fields the same way
+ */
+template <int64_t LoanSeconds, int64_t GraceSeconds, int64_t CentsPerPeriod, int64_t PeriodSeconds,
+          int64_t CapCents = 0>
+struct FixedLoanPolicy {
+    static_assert(LoanSeconds >= 0 && GraceSeconds >= 0 && CentsPerPeriod >= 0 && CapCents >= 0,
+                  "loan policy values cannot be negative");
+    static_assert(PeriodSeconds > 0, "fine period must be positive");
+
+    static constexpr int64_t loanSeconds = LoanSeconds;
+    static constexpr int64_t graceSeconds = GraceSeconds;
+    static constexpr int64_t centsPerPeriod = CentsPerPeriod;
+    static constexpr int64_t periodSeconds = PeriodSeconds;
+    static constexpr int64_t capCents = CapCents;
+};
+
+// 5 second loans at $2 per second late, for demonstration
+using DemoLoanPolicy = FixedLoanPolicy<5, 0, 200, 1>;
+
+struct LoanPolicy {
+    int64_t loanSeconds = DemoLoanPolicy::loanSeconds;
+    int64_t graceSeconds = DemoLoanPolicy::graceSeconds;
+    int64_t centsPerPeriod = DemoLoanPolicy::centsPerPeriod;
+    int64_t periodSeconds = DemoLoanPolicy::periodSeconds;
+    int64_t capCents = DemoLoanPolicy::capCents;
+};
+
+// Highest fine one loan can reach under policy
+template <typename Policy>
+inline int64_t fineLimit(const Policy& policy) {
+    return policy.capCents > 0 ? policy.capCents : INT64_MAX;
+}
+
+// Cents a loan due at due owes for its lateness up to through. Past the cap only
+// the limit counts, so a later charge is the difference of two of these
+template <typename Policy>
+inline int64_t lateFine(const Policy& policy, int64_t due, int64_t through) {
+    int64_t late = through - due - policy.graceSeconds;
+    return late > 0 ? std::min(late / policy.periodSeconds * policy.centsPerPeriod, fineLimit(policy)) : 0;
+}
+
+/*
+ * LoanPolicyTable Class
+ * The runtime policy of each patron class. Classes are small integers
+ * kept on the User, so finding a patron's rules is one array index
+ */
+class LoanPolicyTable {
+public:
+    static const uint32_t MaxClasses = 16;
+
+private:
+    LoanPolicy policies[MaxClasses];
+
+public:
+    const LoanPolicy& operator[](uint32_t patronClass) const { return policies[patronClass]; }
+
+    // Replaces the rules of one class; returns false if it is out of range or not valid
+    bool set(uint32_t patronClass, const LoanPolicy& policy) {
+        if (patronClass >= MaxClasses || policy.loanSeconds < 0 || policy.graceSeconds < 0 ||
+            policy.centsPerPeriod < 0 || policy.periodSeconds <= 0 || policy.capCents < 0) {
+            return false;
+        }
+        policies[patronClass] = policy;
+        return true;
+    }
+};
+
+/*
+ * LoanPool Class
+ * Shared allocator for loan lists that outgrow their inline storage.
+ * Blocks come in power-of-two classes of 16, 32, 64, ... handles, carved
+ * from 64 KiB slabs and recycled through a free list per class, so a
+ * growing or shrinking list never goes to the general heap after warm-up.
+ * Spilling is rare, so one mutex guards the pool
+ */
+class LoanPool {
+private:
+    static const uint32_t MinBits = 4;
+    static const uint32_t Classes = 20;            // Up to 16 << 19 handles per list
+    static const size_t SlabBytes = 64 * 1024;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::mutex lock;
+    FreeBlock* freeLists[Classes] = {};
+    std::vector<std::unique_ptr<char[]>> slabs;
+    char* slabCursor = nullptr;
+    size_t slabLeft = 0;
+
+    static uint32_t classOf(uint32_t capacity) {
+        uint32_t sizeClass = 0;
+        while ((16u << sizeClass) < capacity) {
+            ++sizeClass;
+        }
+        return sizeClass;
+    }
+
+public:
+    static LoanPool& shared() {
+        static LoanPool instance;
+        return instance;
+    }
+
+    // Rounds a wanted capacity up to the size of the block that would hold it
+    static uint32_t roundUp(uint32_t capacity) { return 16u << classOf(capacity); }
+
+    BookHandle* allocate(uint32_t capacity) {
+        uint32_t sizeClass = classOf(capacity);
+        size_t bytes = (size_t(16) << sizeClass) * sizeof(BookHandle);
+        std::lock_guard<std::mutex> guard(lock);
+        if (FreeBlock* block = freeLists[sizeClass]) {
+            freeLists[sizeClass] = block->next;
+            return reinterpret_cast<BookHandle*>(block);
+        }
+        if (bytes > SlabBytes / 4) {
+            slabs.emplace_back(new char[bytes]);  // Large lists get a slab of their own
+            return reinterpret_cast<BookHandle*>(slabs.back().get());
+        }
+        if (slabLeft < bytes) {
+            slabs.emplace_back(new char[SlabBytes]);
+            slabCursor = slabs.back().get();
+            slabLeft = SlabBytes;
+        }
+        char* block = slabCursor;
+        slabCursor += bytes;
+        slabLeft -= bytes;
+        return reinterpret_cast<BookHandle*>(block);
+    }
+
+    void release(BookHandle* block, uint32_t capacity) {
+        uint32_t sizeClass = classOf(capacity);
+        std::lock_guard<std::mutex> guard(lock);
+        FreeBlock* freed = reinterpret_cast<FreeBlock*>(block);
+        freed->next = freeLists[sizeClass];
+        freeLists[sizeClass] = freed;
+    }
+};
+
+/*
+ * LoanList Class
+ * A patron's loans: up to InlineCapacity handles stored in the list itself,
+ * which covers almost every patron without a heap allocation, spilling
+ * into LoanPool blocks beyond that. Vector-like interface, no ordering
+ */
+class LoanList {
+public:
+    static const uint32_t InlineCapacity = 8;
+
+private:
+    uint32_t count = 0;
+    uint32_t capacity = InlineCapacity;
+    union Storage {
+        BookHandle local[InlineCapacity];
+        BookHandle* spilled;
+        Storage() {}
+    } storage;
+
+    bool isInline() const { return capacity == InlineCapacity; }
+    BookHandle* data() { return isInline() ? storage.local : storage.spilled; }
+    const BookHandle* data() const { return isInline() ? storage.local : storage.spilled; }
+
+    void grow(uint32_t wanted) {
+        uint32_t next = LoanPool::roundUp(wanted);
+        BookHandle* block = LoanPool::shared().allocate(next);
+        std::copy(data(), data() + count, block);
+        if (!isInline()) {
+            LoanPool::shared().release(storage.spilled, capacity);
+        }
+        storage.spilled = block;
+        capacity = next;
+    }
+
+    // Hands a spilled block back to the pool and leaves the list empty and inline
+    void release() {
+        if (!isInline()) {
+            LoanPool::shared().release(storage.spilled, capacity);
+            capacity = InlineCapacity;
+        }
+        count = 0;
+    }
+
+    void steal(LoanList& other) {
+        count = other.count;
+        capacity = other.capacity;
+        if (other.isInline()) {
+            std::copy(other.storage.local, other.storage.local + count, storage.local);
+        } else {
+            storage.spilled = other.storage.spilled;
+        }
+        other.count = 0;
+        other.capacity = InlineCapacity;
+    }
+
+public:
+    LoanList() = default;
+    LoanList(const LoanList& other) {
+        reserve(other.count);
+        std::copy(other.begin(), other.end(), data());
+        count = other.count;
+    }
+    LoanList(LoanList&& other) noexcept { steal(other); }
+    LoanList& operator=(LoanList other) noexcept {
+        release();
+        steal(other);
+        return *this;
+    }
+    ~LoanList() { release(); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    BookHandle& operator[](size_t position) { return data()[position]; }
+    const BookHandle& operator[](size_t position) const { return data()[position]; }
+    const BookHandle& back() const { return data()[count - 1]; }
+    const BookHandle* begin() const { return data(); }
+    const BookHandle* end() const { return data() + count; }
+
+    void reserve(size_t wanted) {
+        if (wanted > capacity) {
+            grow(static_cast<uint32_t>(wanted));
+        }
+    }
+
+    void push_back(BookHandle handle) {
+        if (count == capacity) {
+            grow(capacity + 1);
+        }
+        data()[count++] = handle;
+    }
+
+    // Drops the last loan; a spilled list that fits inline again moves back
+    void pop_back() {
+        --count;
+        if (!isInline() && count <= InlineCapacity / 2) {
+            BookHandle* block = storage.spilled;
+            uint32_t blockCapacity = capacity;
+            std::copy(block, block + count, storage.local);
+            capacity = InlineCapacity;
+            LoanPool::shared().release(block, blockCapacity);
+        }
+    }
+};
+
+/*
+ * User Class
+ * Represents a library patron who can borrow books
+ */
+class User {
+private:
+    std::string_view name;
+    std::string_view userID;
+    LoanList borrowedBooks;                 // Tracks books currently borrowed, in no particular order
+    int64_t fineCents;                      // Accumulated fines, in cents
+    uint32_t account;                       // Position in the UserDirectory, recorded on loaned books
+    uint32_t patronClass = 0;               // Selects the user's LoanPolicy in a LoanPolicyTable
+    std::atomic<bool>* changed = nullptr;   // The UserDirectory chunk flag read by CatalogView
+    StatCounter* outstanding = nullptr;     // The UserDirectory's total of unpaid fines
+    std::vector<BookHandle> readyHolds;     // Holds filled for this user and not yet announced
+
+    friend class Snapshot;
+    friend class UserDirectory;
+    friend class CatalogView;
+
+    // Marks this user's chunk as written since the last report view
+    void touch() {
+        if (changed != nullptr) {
+            changed->store(true, std::memory_order_relaxed);
+        }
+    }
+
+    // Every change to the balance goes through here, so the directory total stays exact
+    void addFines(int64_t cents) {
+        fineCents += cents;
+        if (outstanding != nullptr) {
+            outstanding->add(cents);
+        }
+        touch();
+    }
+
+public:
+    // Constructor initializes user details with no fines
+    // (the views must outlive the user; UserDirectory interns them)
+    User(std::string_view name, std::string_view userID)
+        : name(name), userID(userID), fineCents(0), account(Book::NoBorrower) {}
+
+    // Getter methods
+    std::string_view getName() const { return name; }
+    std::string_view getUserID() const { return userID; }
+    double getFines() const { return fineCents / 100.0; }
+    int64_t getFineCents() const { return fineCents; }
+    const LoanList& getBorrowedBooks() const { return borrowedBooks; }
+    uint32_t getAccount() const { return account; }
+    uint32_t getPatronClass() const { return patronClass; }
+
+    // Hold notices wait here for the patron's next command; both belong to the user's shard
+    void addReadyHold(BookHandle handle) { readyHolds.push_back(handle); }
+    void takeReadyHolds(std::vector<BookHandle>& out) {
+        out.swap(readyHolds);
+        readyHolds.clear();
+    }
+
+    // Outstanding loans keep their due dates; the new class's fines apply from now on
+    void setPatronClass(uint32_t next) {
+        patronClass = next;
+        touch();
+    }
+
+    // True if this user holds book; O(1) through the book's loan back-reference. The slot
+    // is read only once the borrower is known to be this user: another borrower's return
+    // may be rewriting it under locks this caller does not hold
+    bool holds(const Book* book) const {
+        if (book->getAvailability() || book->getBorrower() != account) {
+            return false;
+        }
+        uint32_t slot = book->getLoanSlot();
+        return slot < borrowedBooks.size() && borrowedBooks[slot] == book->getHandle();
+    }
+
+    // This user's copy of the title with a packed ISBN key, or nullptr; scans only the user's loans
+    Book* loanOf(Inventory& inventory, uint64_t key) const {
+        for (BookHandle handle : borrowedBooks) {
+            Book* book = inventory.get(handle);
+            if (book != nullptr && book->getIsbnKey() == key) {
+                return book;
+            }
+        }
+        return nullptr;
+    }
+
+    // Borrows a book without printing; the due date is policy.loanSeconds after now
+    template <typename Policy = DemoLoanPolicy>
+    LoanResult tryBorrow(Book* book, time_t now, const Policy& policy = Policy()) {
+        LMS_TIME(Borrow);
+        if (!book->getAvailability()) {
+            return LoanResult::NotAvailable;
+        }
+        book->setLoan(account, static_cast<uint32_t>(borrowedBooks.size()));
+        borrowedBooks.push_back(book->getHandle());
+        touch();
+        book->setAvailability(false);
+        book->setDueDate(now + policy.loanSeconds);
+        book->setAccruedThrough(now + policy.loanSeconds);
+        return LoanResult::Ok;
+    }
+
+    // Returns a book without printing; fine receives the cents charged if it was late
+    // (beyond what batch accrual already charged). The last loan moves into the returned
+    // book's slot, so this is O(1) for any number of loans; inventory resolves the moved
+    // loan to update its back-reference
+    template <typename Policy>
+    LoanResult tryReturn(Inventory& inventory, Book* book, time_t now,
+                         const Policy& policy, int64_t& fine) {
+        LMS_TIME(Return);
+        if (!holds(book)) {
+            return LoanResult::NotBorrowed;
+        }
+        uint32_t slot = book->getLoanSlot();
+        BookHandle moved = borrowedBooks.back();
+        borrowedBooks[slot] = moved;
+        borrowedBooks.pop_back();
+        if (moved != book->getHandle()) {
+            // Only this user's own calls read the moved book's slot (holds() checks the
+            // borrower first), and the service serializes those under this user's shard lock
+            inventory.get(moved)->setLoanSlot(slot);
+        }
+        book->setLoan(Book::NoBorrower, 0);
+        book->setAvailability(true);
+
+        // Calculate fine if overdue
+        int64_t due = static_cast<int64_t>(book->getDueDate());
+        fine = std::max<int64_t>(lateFine(policy, due, now) -
+                                 lateFine(policy, due, book->getAccruedThrough()), 0);
+        addFines(fine);
+
+        book->setDueDate(0);
+        book->setAccruedThrough(0);
+        return LoanResult::Ok;
+    }
+
+    // Pays fines without printing
+    LoanResult tryPayFines(int64_t cents) {
+        LMS_TIME(PayFines);
+        if (cents < 0) {
+            return LoanResult::InvalidAmount;
+        }
+        if (cents > fineCents) {
+            return LoanResult::Overpaid;
+        }
+        addFines(-cents);
+        return LoanResult::Ok;
+    }
+
+    // Adds an accrued fine to the balance
+    void chargeFine(int64_t cents) { addFines(cents); }
+
+    // Allows user to borrow a book
+    template <typename Policy = DemoLoanPolicy>
+    bool borrowBook(Book* book, time_t now = time(0), const Policy& policy = Policy()) {
+        if (tryBorrow(book, now, policy) == LoanResult::Ok) {  // it checks if the book is available
+            std::cout << "Book borrowed successfully.\n";
+            return true;
+        }
+        std::cout << "Book is not available.\n";
+        return false;
+    }
+
+    // Allows user to return a book
+    template <typename Policy = DemoLoanPolicy>
+    bool returnBook(Inventory& inventory, Book* book, time_t now = time(0),
+                    const Policy& policy = Policy()) {
+        int64_t fine = 0;
+        if (tryReturn(inventory, book, now, policy, fine) != LoanResult::Ok) {
+            std::cout << "You didn't borrow this book.\n";
+            return false;
+        }
+        if (fine > 0) {
+            std::cout << "Book returned late. Fine added: $" << formatCents(fine) << "\n";
+        }
+        std::cout << "Book returned successfully.\n";
+        return true;
+    }
+
+    // Allows user to pay fines (amount in dollars, rounded to the cent)
+    bool payFines(double amount) {
+        int64_t cents = static_cast<int64_t>(std::llround(amount * 100.0));
+        LoanResult result = tryPayFines(cents);
+        if (result == LoanResult::Ok) {
+            std::cout << "Paid $" << formatCents(cents) << " towards fines. Remaining: $"
+                      << formatCents(fineCents) << "\n";
+            return true;
+        }
+        std::cout << (result == LoanResult::InvalidAmount ? "Payment cannot be negative.\n"
+                                                          : "Payment exceeds owed fines.\n");
+        return false;
+    }
+
+    // Displays user information
+    void displayInfo() const {
+        std::cout << "User: " << name << "\nID: " << userID
+                  << "\nFines: $" << formatCents(fineCents) << "\nBorrowed books: "
+                  << borrowedBooks.size() << "\n";
+    }
+};
+
+/*
+ * UserDirectory Class
+ * Owns all registered users in registration order and keeps a HashIndex
+ * from userID to position, so a patron is resolved in O(1). The index
+ * holds no copies of the IDs; it compares against each User's own userID
+ */
+class UserDirectory {
+public:
+    static const size_t ChunkSize = 1024;  // Users per CatalogView page
+
+private:
+    std::vector<User> users;
+    HashIndex idIndex;  // userID -> position in users, plus one
+    StringArena text;   // Names (interned) and userIDs
+    std::deque<std::atomic<bool>> changedChunks;  // Per ChunkSize users: written since the last CatalogView
+    StatCounter outstanding;                        // Sum of every user's unpaid fines, in cents
+
+    friend class CatalogView;
+
+    size_t probe(std::string_view userID, uint32_t hash) const {
+        return idIndex.probe(hash, [this, userID](uint32_t value) {
+            return users[value - 1].userID == userID;
+        });
+    }
+
+public:
+    static const size_t NotFound = static_cast<size_t>(-1);
+
+    // Container-style access by registration position
+    size_t size() const { return users.size(); }
+    bool empty() const { return users.empty(); }
+    User& operator[](size_t position) { return users[position]; }
+    const User& operator[](size_t position) const { return users[position]; }
+    std::vector<User>::const_iterator begin() const { return users.begin(); }
+    std::vector<User>::const_iterator end() const { return users.end(); }
+
+    void reserve(size_t count) {
+        users.reserve(count);
+        idIndex.reserve(count);
+    }
+
+    // Unpaid fines of all users together, in cents; O(1)
+    int64_t outstandingFineCents() const { return outstanding.get(); }
+
+    // Returns the position of the user with userID, or NotFound
+    size_t indexOf(std::string_view userID) const {
+        size_t pos = probe(userID, HashIndex::hashString(userID));
+        return idIndex.occupied(pos) ? idIndex.value(pos) - 1 : NotFound;
+    }
+
+    User* find(std::string_view userID) {
+        size_t index = indexOf(userID);
+        return index != NotFound ? &users[index] : nullptr;
+    }
+
+    // Registers a user; returns its position, or NotFound if the userID is taken
+    size_t add(std::string_view name, std::string_view userID) {
+        idIndex.reserve(idIndex.size() + 1);
+        uint32_t hash = HashIndex::hashString(userID);
+        size_t pos = probe(userID, hash);
+        if (idIndex.occupied(pos)) {
+            return NotFound;
+        }
+        users.emplace_back(text.intern(name), text.copy(userID));
+        users.back().account = static_cast<uint32_t>(users.size() - 1);
+        if (users.back().account % ChunkSize == 0) {
+            changedChunks.emplace_back(true);
+        }
+        users.back().changed = &changedChunks.back();
+        users.back().outstanding = &outstanding;
+        users.back().touch();
+        idIndex.insert(pos, static_cast<uint32_t>(users.size()), hash);
+        return users.size() - 1;
+    }
+};
+
+/*
+ * CatalogView Class
+ * Immutable point-in-time copy of what reports read: every book slot's
+ * title, availability, due date and borrower, and every user's name, ID,
+ * fines and loan count. It is built from pages of 1024 entries held by
+ * shared_ptr, and a new view shares every page not written since the
+ * previous one (the Inventory's page columns and the UserDirectory's
+ * chunks carry a changed flag), so capturing copies only what changed.
+ * Once captured a view needs no locks: a long report walks it while
+ * circulation carries on, and it stays valid for as long as it is held.
+ * Title text lives in arenas that never free, so titles stay readable
+ * even after their last copy is removed
+ */
+class CatalogView {
+public:
+    static const uint32_t PageSize = BookColumns::Size;
+
+    struct BookPage {
+        const Title* titles[PageSize];  // nullptr for an empty slot
+        uint64_t available[PageSize / 64];
+        int64_t dueDates[PageSize];
+        uint32_t borrowers[PageSize];
+        uint32_t bookCount;             // Non-empty slots
+    };
+
+    struct UserPage {
+        std::string_view names[PageSize];
+        std::string_view userIDs[PageSize];
+        int64_t fineCents[PageSize];
+        uint32_t loanCounts[PageSize];
+    };
+
+private:
+    std::vector<std::shared_ptr<const BookPage>> bookPages;
+    std::vector<std::shared_ptr<const UserPage>> userPages;
+    size_t bookCount = 0;
+    size_t userCount = 0;
+    size_t copiedPages = 0;
+
+    static std::shared_ptr<const BookPage> copy(const Inventory::Page& page) {
+        std::shared_ptr<BookPage> out = std::make_shared<BookPage>();
+        for (uint32_t i = 0; i < PageSize / 64; ++i) {
+            out->available[i] = page.columns.available[i].load(std::memory_order_relaxed);
+        }
+        std::copy(std::begin(page.columns.dueDates), std::end(page.columns.dueDates), out->dueDates);
+        out->bookCount = 0;
+        for (uint32_t i = 0; i < PageSize; ++i) {
+            const std::optional<Book>& book = page.slots[i].book;
+            out->titles[i] = book ? book->record : nullptr;
+            out->borrowers[i] = book ? book->borrower : Book::NoBorrower;
+            out->bookCount += book ? 1 : 0;
+        }
+        return out;
+    }
+
+    static std::shared_ptr<const UserPage> copy(const UserDirectory& users, size_t chunk) {
+        std::shared_ptr<UserPage> out = std::make_shared<UserPage>();
+        size_t first = chunk * PageSize, count = std::min<size_t>(PageSize, users.size() - first);
+        for (size_t i = 0; i < count; ++i) {
+            const User& user = users[first + i];
+            out->names[i] = user.name;
+            out->userIDs[i] = user.userID;
+            out->fineCents[i] = user.fineCents;
+            out->loanCounts[i] = static_cast<uint32_t>(user.borrowedBooks.size());
+        }
+        return out;
+    }
+
+public:
+    // Captures the current state, sharing every page unchanged since previous (which must
+    // be the last view captured from the same inventory and users, or nullptr). Nothing
+    // may write to the inventory or users while this runs; it is O(pages) plus the copying
+    // of changed pages
+    static std::shared_ptr<const CatalogView> capture(Inventory& inventory, UserDirectory& users,
+                                                      const CatalogView* previous) {
+        static_assert(UserDirectory::ChunkSize == PageSize, "user chunks must match view pages");
+        std::shared_ptr<CatalogView> view = std::make_shared<CatalogView>();
+        view->bookCount = inventory.size();
+        view->userCount = users.size();
+
+        view->bookPages.reserve(inventory.pages.size());
+        for (size_t p = 0; p < inventory.pages.size(); ++p) {
+            Inventory::Page& page = *inventory.pages[p];
+            bool changed = page.columns.changed.exchange(false, std::memory_order_relaxed);
+            if (!changed && previous != nullptr && p < previous->bookPages.size()) {
+                view->bookPages.push_back(previous->bookPages[p]);
+            } else {
+                view->bookPages.push_back(copy(page));
+                ++view->copiedPages;
+            }
+        }
+
+        view->userPages.reserve(users.changedChunks.size());
+        for (size_t chunk = 0; chunk < users.changedChunks.size(); ++chunk) {
+            bool changed = users.changedChunks[chunk].exchange(false, std::memory_order_relaxed);
+            if (!changed && previous != nullptr && chunk < previous->userPages.size()) {
+                view->userPages.push_back(previous->userPages[chunk]);
+            } else {
+                view->userPages.push_back(copy(users, chunk));
+                ++view->copiedPages;
+            }
+        }
+        return view;
+    }
+
+    size_t getBookCount() const { return bookCount; }
+    size_t getUserCount() const { return userCount; }
+
+    // Pages this view had to copy rather than share with the previous one
+    size_t getCopiedPages() const { return copiedPages; }
+
+    // Calls visit(title, available, dueDate, borrower) for every book, in slot order
+    template <typename Visit>
+    void forEachBook(Visit visit) const {
+        for (const std::shared_ptr<const BookPage>& page : bookPages) {
+            for (uint32_t i = 0; i < PageSize; ++i) {
+                if (page->titles[i] != nullptr) {
+                    bool available = (page->available[i >> 6] >> (i & 63)) & 1;
+                    visit(*page->titles[i], available, static_cast<time_t>(page->dueDates[i]), page->borrowers[i]);
+                }
+            }
+        }
+    }
+
+    // Calls visit(position, title, available, dueDate, borrower) for the books from
+    // position first on, in slot order, until visit returns false. Pages wholly before
+    // first are skipped by their book count, so a walk costs the pages plus the books visited
+    template <typename Visit>
+    void forEachBookFrom(size_t first, Visit visit) const {
+        size_t position = 0;
+        for (const std::shared_ptr<const BookPage>& page : bookPages) {
+            if (position + page->bookCount <= first) {
+                position += page->bookCount;
+                continue;
+            }
+            for (uint32_t i = 0; i < PageSize; ++i) {
+                if (page->titles[i] == nullptr || position++ < first) {
+                    continue;
+                }
+                bool available = (page->available[i >> 6] >> (i & 63)) & 1;
+                if (!visit(position - 1, *page->titles[i], available, static_cast<time_t>(page->dueDates[i]),
+                           page->borrowers[i])) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // Per-user fields by registration position
+    std::string_view getUserName(size_t position) const { return userPages[position / PageSize]->names[position % PageSize]; }
+    std::string_view getUserID(size_t position) const { return userPages[position / PageSize]->userIDs[position % PageSize]; }
+    int64_t getFineCents(size_t position) const { return userPages[position / PageSize]->fineCents[position % PageSize]; }
+    uint32_t getLoanCount(size_t position) const { return userPages[position / PageSize]->loanCounts[position % PageSize]; }
+};
+
+/*
+ * InventoryPage Struct
+ * The part of the inventory a listing covers: starting at position offset,
+ * up to limit books that pass the availability filter. A listing returns
+ * the position to continue from, so pages can be walked like a cursor
+ */
+struct InventoryPage {
+    enum class Filter { All, Available, CheckedOut };
+
+    size_t offset = 0;
+    size_t limit = SIZE_MAX;
+    Filter filter = Filter::All;
+};
+
+/*
+ * Librarian Class
+ * Handles administrative tasks for the library
+ */
+class Librarian {
+private:
+    std::string name;
+    std::string employeeID;
+    mutable std::string listing;  // Reused output buffer for inventory listings
+
+    static const size_t ListingChunk = 64 * 1024;
+
+public:
+    // Constructor
+    Librarian(std::string name, std::string employeeID)
+        : name(name), employeeID(employeeID) {}
+
+    // Adds a copy of a book to the inventory (a new title if the ISBN is new);
+    // returns its handle, or an invalid one on failure
+    BookHandle addBook(Inventory& inventory, const std::string& title,
+                       const std::string& author, const std::string& ISBN) {
+        LMS_TIME(AddBook);
+        if (Isbn::parse(ISBN) == Isbn::Invalid) {
+            std::cout << "Invalid ISBN: " << ISBN << "\n";
+            return BookHandle();
+        }
+        BookHandle handle = inventory.add(title, author, ISBN);
+        const Book* book = inventory.get(handle);
+        if (book == nullptr) {
+            std::cout << "Inventory is full.\n";
+        } else if (book->getRecord()->getCopyCount() == 1) {
+            std::cout << "Book added to inventory.\n";
+        } else {
+            std::cout << "Copy added to inventory (" << book->getRecord()->getCopyCount()
+                      << " copies of this title).\n";
+        }
+        return handle;
+    }
+
+    // Removes one shelved copy of a book from inventory by ISBN; returns the
+    // handle of the copy removed, or an invalid one
+    BookHandle removeBook(Inventory& inventory, const std::string& ISBN) {
+        LMS_TIME(RemoveBook);
+        Title* record = inventory.findTitle(ISBN);
+        if (record == nullptr) {
+            std::cout << "Book not found in inventory.\n";
+            return BookHandle();
+        }
+        const Book* book = record->anyAvailable();
+        if (book == nullptr) {
+            // Removing a checked-out copy would strand the borrower's loan
+            std::cout << "All copies are checked out and none can be removed.\n";
+            return BookHandle();
+        }
+        BookHandle handle = book->getHandle();
+        inventory.removeCopy(handle);
+        std::cout << "Book removed from inventory.\n";
+        return handle;
+    }
+
+    // Removes every shelved copy of a set of ISBNs in one pass (see Inventory::removeAll)
+    // and prints a single summary line; removed receives the handles of the copies removed
+    size_t removeBooks(Inventory& inventory, const std::vector<std::string>& ISBNs,
+                       std::vector<BookHandle>& removed) {
+        LMS_TIME(RemoveBook);
+        size_t missing = 0;
+        size_t count = inventory.removeAll(ISBNs, removed, missing);
+        std::cout << count << " books removed from inventory (" << missing
+                  << " ISBNs not found; checked-out copies are kept).\n";
+        return count;
+    }
+
+    // Adds a batch of books in one pass and prints a single summary line
+    template <typename Range>
+    size_t addBooks(Inventory& inventory, const Range& records) {
+        auto started = std::chrono::steady_clock::now();
+        size_t total = static_cast<size_t>(std::distance(std::begin(records), std::end(records)));
+        size_t added = inventory.addAll(std::begin(records), std::end(records));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        std::cout << added << " books added to inventory (" << total - added
+                  << " skipped) in " << seconds * 1000.0 << " ms, "
+                  << static_cast<uint64_t>(seconds > 0 ? total / seconds : 0) << " records/sec.\n";
+        return added;
+    }
+
+    // Displays one page of the inventory (all of it by default). Books are
+    // formatted into one reusable buffer that is written out in large chunks.
+    // Returns the position after the last book examined; inventory.size()
+    // once the listing is complete
+    size_t displayInventory(const Inventory& inventory, const InventoryPage& page = InventoryPage()) const {
+        listing.clear();
+        if (page.offset == 0) {
+            listing.append("\nLibrary Inventory:\n");
+        }
+        size_t position = page.offset, shown = 0;
+        for (; position < inventory.size() && shown < page.limit; ++position) {
+            const Book& book = inventory[position];
+            if ((page.filter == InventoryPage::Filter::Available && !book.getAvailability()) ||
+                (page.filter == InventoryPage::Filter::CheckedOut && book.getAvailability())) {
+                continue;
+            }
+            book.appendInfo(listing);
+            listing.append("-----------------\n");
+            ++shown;
+            if (listing.size() >= ListingChunk) {
+                std::cout.write(listing.data(), static_cast<std::streamsize>(listing.size()));
+                listing.clear();
+            }
+        }
+        if (position < inventory.size()) {
+            listing.append("Listing paused at position ").append(std::to_string(position))
+                   .append(" of ").append(std::to_string(inventory.size())).append(".\n");
+        }
+        std::cout.write(listing.data(), static_cast<std::streamsize>(listing.size()));
+        if (listing.capacity() > 4 * ListingChunk) {
+            std::string().swap(listing);
+        }
+        return position;
+    }
+
+    // Displays one page of a point-in-time view, with positions in slot order; reads
+    // nothing from the live inventory. Returns the position to continue from, or the
+    // view's book count once the listing is complete
+    size_t displayInventory(const CatalogView& view, const InventoryPage& page) const {
+        listing.clear();
+        if (page.offset == 0) {
+            listing.append("\nLibrary Inventory:\n");
+        }
+        size_t shown = 0, next = view.getBookCount();
+        view.forEachBookFrom(page.offset, [&](size_t position, const Title& record, bool available, time_t, uint32_t) {
+            if ((page.filter == InventoryPage::Filter::Available && !available) ||
+                (page.filter == InventoryPage::Filter::CheckedOut && available)) {
+                return true;
+            }
+            if (shown == page.limit) {
+                next = position;  // First book of the following page
+                return false;
+            }
+            Book::appendInfo(listing, record, available);
+            listing.append("-----------------\n");
+            ++shown;
+            if (listing.size() >= ListingChunk) {
+                std::cout.write(listing.data(), static_cast<std::streamsize>(listing.size()));
+                listing.clear();
+            }
+            return true;
+        });
+        if (next < view.getBookCount()) {
+            listing.append("Listing paused at position ").append(std::to_string(next))
+                   .append(" of ").append(std::to_string(view.getBookCount())).append(".\n");
+        }
+        std::cout.write(listing.data(), static_cast<std::streamsize>(listing.size()));
+        if (listing.capacity() > 4 * ListingChunk) {
+            std::string().swap(listing);
+        }
+        return next;
+    }
+
+    // Lists every user of a point-in-time view with their fines and loan count
+    void displayUsers(const CatalogView& view) const {
+        listing.clear();
+        listing.append("\nRegistered Users:\n");
+        for (size_t i = 0; i < view.getUserCount(); ++i) {
+            listing.append(view.getUserName(i)).append(" (ID ").append(view.getUserID(i))
+                   .append("): fines $").append(formatCents(view.getFineCents(i)))
+                   .append(", ").append(std::to_string(view.getLoanCount(i))).append(" books borrowed\n");
+            if (listing.size() >= ListingChunk) {
+                std::cout.write(listing.data(), static_cast<std::streamsize>(listing.size()));
+                listing.clear();
+            }
+        }
+        listing.append(std::to_string(view.getUserCount())).append(" users.\n");
+        std::cout.write(listing.data(), static_cast<std::streamsize>(listing.size()));
+        if (listing.capacity() > 4 * ListingChunk) {
+            std::string().swap(listing);
+        }
+    }
+
+    // Lists the titles matching a title/author query, numbered from 0; matches
+    // receives them (at most limit) so a caller can pick one
+    size_t searchCatalog(Inventory& inventory, const std::string& query,
+                         std::vector<Title*>& matches, size_t limit = 20) const {
+        LMS_TIME(Search);
+        matches.clear();
+        size_t total = inventory.search(query, limit, matches);
+        for (size_t i = 0; i < matches.size(); ++i) {
+            const Title* record = matches[i];
+            std::cout << i << ". " << record->getTitle() << " by " << record->getAuthor() << " (ISBN "
+                      << record->getISBN() << ") [" << record->getAvailableCount() << " of "
+                      << record->getCopyCount() << " available";
+            if (record->getHoldCount() > 0) {
+                std::cout << ", " << record->getHoldCount() << " waiting";
+            }
+            std::cout << "]\n";
+        }
+        std::cout << total << " matching books";
+        if (total > matches.size()) {
+            std::cout << " (first " << matches.size() << " shown)";
+        }
+        std::cout << ".\n";
+        return total;
+    }
+
+    // Displays user information including borrowed books
+    void displayUserInfo(const User& user, const Inventory& inventory) const {
+        user.displayInfo();
+        std::cout << "Borrowed Books:\n";
+        for (const auto handle : user.getBorrowedBooks()) {
+            if (const Book* book = inventory.get(handle)) {
+                book->displayInfo();
+                std::cout << "-----------------\n";
+            }
+        }
+    }
+};
+
+/*
+ * MappedFile Class
+ * Read-only view of a whole file: mmap where available, otherwise the
+ * file is read into memory
+ */
+class MappedFile {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    std::vector<char> buffer;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (bytes != nullptr && length > 0) {
+            munmap(const_cast<char*>(bytes), length);
+        }
+#endif
+    }
+
+    // Maps path; returns false if it cannot be opened
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            bytes = static_cast<const char*>(mapped);
+        }
+        ::close(fd);
+        return true;
+#endif
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+/*
+ * Snapshot Class
+ * Versioned fixed-layout binary image of the inventory and users.
+ *
+ * Layout (native byte order; every section 8-byte aligned):
+ *   Header
+ *   Book records[bookCount]
+ *   User records[userCount]
+ *   Loan handles[loanCount]   (uint32 BookHandle values, grouped per user)
+ *   String pool[stringBytes]  (referenced by offset/length, not terminated)
+ *   Hold records[holdCount]   (grouped per title, oldest first)
+ *
+ * Books keep their BookHandle, so loans are stored as handles and stay
+ * valid across restarts. Loading maps the file and reads records in place;
+ * only the strings are copied out
+ */
+class Snapshot {
+private:
+    static const uint32_t Version = 5;
+
+    struct StringRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t bookCount;
+        uint64_t userCount;
+        uint64_t loanCount;
+        uint64_t stringBytes;
+        uint64_t booksOffset;
+        uint64_t usersOffset;
+        uint64_t loansOffset;
+        uint64_t stringsOffset;
+        uint64_t logSequence;  // Last OpLog record already reflected in this image
+        uint64_t holdCount;
+        uint64_t holdsOffset;
+    };
+
+    struct BookRecord {
+        StringRef title;
+        StringRef author;
+        StringRef ISBN;
+        uint32_t handle;
+        uint32_t available;
+        uint64_t isbnKey;
+        int64_t dueDate;
+        int64_t accruedThrough;
+    };
+
+    struct UserRecord {
+        StringRef name;
+        StringRef userID;
+        int64_t fineCents;
+        uint64_t firstLoan;
+        uint32_t loanCount;
+        uint32_t patronClass;  // Zero in snapshots written before patron classes
+    };
+
+    // One waiting patron; a title's holds are stored oldest first
+    struct HoldRecord {
+        uint32_t book;     // Handle of any copy of the title
+        uint32_t account;  // Position of the patron in the user section
+    };
+
+    static_assert(sizeof(BookRecord) == 56, "snapshot book record layout changed");
+    static_assert(sizeof(UserRecord) == 40, "snapshot user record layout changed");
+
+    static uint64_t align8(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+    static StringRef intern(std::vector<char>& pool, std::string_view text) {
+        StringRef ref{static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(text.size())};
+        pool.insert(pool.end(), text.begin(), text.end());
+        return ref;
+    }
+
+    // Bounds-checked view of a string in the pool
+    static bool text(const char* strings, uint64_t stringBytes, StringRef ref, std::string& out) {
+        if (uint64_t(ref.offset) + ref.length > stringBytes) {
+            return false;
+        }
+        out.assign(strings + ref.offset, ref.length);
+        return true;
+    }
+
+    template <typename T>
+    static bool sectionFits(const MappedFile& file, uint64_t offset, uint64_t count) {
+        return offset % 8 == 0 && offset <= file.size() &&
+               count <= (file.size() - offset) / sizeof(T);
+    }
+
+public:
+    // Writes the inventory and users to path; the file is replaced atomically
+    static bool save(const std::string& path, const Inventory& inventory,
+                     const UserDirectory& users, uint64_t logSequence) {
+        std::vector<char> pool;
+        std::vector<BookRecord> books;
+        std::vector<UserRecord> userRecords;
+        std::vector<uint32_t> loans;
+        std::vector<HoldRecord> holds;
+        books.reserve(inventory.size());
+        userRecords.reserve(users.size());
+
+        // Copies of one title share its text in the pool: title id -> first record written
+        std::unordered_map<uint32_t, size_t> firstCopy;
+        firstCopy.reserve(inventory.titleCount());
+        for (const Book& book : inventory) {
+            BookRecord record{};
+            auto written = firstCopy.emplace(book.getRecord()->getId(), books.size());
+            if (written.second) {
+                record.title = intern(pool, book.getTitle());
+                record.author = intern(pool, book.getAuthor());
+                record.ISBN = intern(pool, book.getISBN());
+                for (uint32_t account : book.getRecord()->getHolds()) {
+                    holds.push_back(HoldRecord{book.getHandle().getValue(), account});
+                }
+            } else {
+                const BookRecord& first = books[written.first->second];
+                record.title = first.title;
+                record.author = first.author;
+                record.ISBN = first.ISBN;
+            }
+            record.handle = book.getHandle().getValue();
+            record.isbnKey = book.getIsbnKey();
+            record.available = book.getAvailability() ? 1 : 0;
+            record.dueDate = static_cast<int64_t>(book.getDueDate());
+            record.accruedThrough = static_cast<int64_t>(book.getAccruedThrough());
+            books.push_back(record);
+        }
+        for (const User& user : users) {
+            UserRecord record{};
+            record.name = intern(pool, user.name);
+            record.userID = intern(pool, user.userID);
+            record.fineCents = user.fineCents;
+            record.firstLoan = loans.size();
+            record.loanCount = static_cast<uint32_t>(user.borrowedBooks.size());
+            record.patronClass = user.patronClass;
+            for (BookHandle handle : user.borrowedBooks) {
+                loans.push_back(handle.getValue());
+            }
+            userRecords.push_back(record);
+        }
+        if (pool.size() > 0xFFFFFFFFull) {
+            std::cout << "Snapshot string pool exceeds 4 GiB.\n";
+            return false;
+        }
+
+        Header header{};
+        std::memcpy(header.magic, "LMSSNAP", 8);
+        header.version = Version;
+        header.headerSize = sizeof(Header);
+        header.bookCount = books.size();
+        header.userCount = userRecords.size();
+        header.loanCount = loans.size();
+        header.stringBytes = pool.size();
+        header.booksOffset = align8(sizeof(Header));
+        header.usersOffset = align8(header.booksOffset + books.size() * sizeof(BookRecord));
+        header.loansOffset = align8(header.usersOffset + userRecords.size() * sizeof(UserRecord));
+        header.stringsOffset = align8(header.loansOffset + loans.size() * sizeof(uint32_t));
+        header.logSequence = logSequence;
+        header.holdCount = holds.size();
+        header.holdsOffset = align8(header.stringsOffset + pool.size());
+
+        std::string temp = path + ".tmp";
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "Cannot write snapshot: " << temp << "\n";
+            return false;
+        }
+        auto writeAt = [&out](uint64_t offset, const void* data, size_t size) {
+            static const char zeros[8] = {};
+            uint64_t at = static_cast<uint64_t>(out.tellp());
+            out.write(zeros, static_cast<std::streamsize>(offset - at));
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeAt(header.booksOffset, books.data(), books.size() * sizeof(BookRecord));
+        writeAt(header.usersOffset, userRecords.data(), userRecords.size() * sizeof(UserRecord));
+        writeAt(header.loansOffset, loans.data(), loans.size() * sizeof(uint32_t));
+        writeAt(header.stringsOffset, pool.data(), pool.size());
+        writeAt(header.holdsOffset, holds.data(), holds.size() * sizeof(HoldRecord));
+        out.close();
+        if (!out || std::rename(temp.c_str(), path.c_str()) != 0) {
+            std::cout << "Cannot write snapshot: " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Replaces the (empty) inventory and users with the contents of path.
+    // Returns false and leaves a message if the file is missing or invalid
+    static bool load(const std::string& path, Inventory& inventory,
+                     UserDirectory& users, uint64_t& logSequence) {
+        MappedFile file;
+        if (!file.open(path)) {
+            std::cout << "Cannot open snapshot: " << path << "\n";
+            return false;
+        }
+        Header header;
+        if (file.size() < sizeof(Header)) {
+            std::cout << "Snapshot is truncated: " << path << "\n";
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (std::memcmp(header.magic, "LMSSNAP", 8) != 0 || header.version != Version ||
+            header.headerSize != sizeof(Header)) {
+            std::cout << "Unsupported snapshot format: " << path << "\n";
+            return false;
+        }
+        if (!sectionFits<BookRecord>(file, header.booksOffset, header.bookCount) ||
+            !sectionFits<UserRecord>(file, header.usersOffset, header.userCount) ||
+            !sectionFits<uint32_t>(file, header.loansOffset, header.loanCount) ||
+            !sectionFits<char>(file, header.stringsOffset, header.stringBytes) ||
+            !sectionFits<HoldRecord>(file, header.holdsOffset, header.holdCount)) {
+            std::cout << "Snapshot is truncated: " << path << "\n";
+            return false;
+        }
+
+        const BookRecord* books = reinterpret_cast<const BookRecord*>(file.data() + header.booksOffset);
+        const UserRecord* userRecords = reinterpret_cast<const UserRecord*>(file.data() + header.usersOffset);
+        const uint32_t* loans = reinterpret_cast<const uint32_t*>(file.data() + header.loansOffset);
+        const char* strings = file.data() + header.stringsOffset;
+        logSequence = header.logSequence;
+
+        inventory.reserve(header.bookCount);
+        std::string title, author, ISBN;
+        for (uint64_t i = 0; i < header.bookCount; ++i) {
+            const BookRecord& record = books[i];
+            Book* book = nullptr;
+            if (text(strings, header.stringBytes, record.title, title) &&
+                text(strings, header.stringBytes, record.author, author) &&
+                text(strings, header.stringBytes, record.ISBN, ISBN)) {
+                book = inventory.restore(BookHandle::fromValue(record.handle), title, author, ISBN, record.isbnKey);
+            }
+            if (book == nullptr) {
+                std::cout << "Snapshot has an invalid book record: " << path << "\n";
+                return false;
+            }
+            book->setAvailability(record.available != 0);
+            book->setDueDate(static_cast<time_t>(record.dueDate));
+            book->setAccruedThrough(static_cast<time_t>(record.accruedThrough));
+        }
+        inventory.rebuildFreeList();
+
+        users.reserve(users.size() + header.userCount);
+        std::string name, userID;
+        for (uint64_t i = 0; i < header.userCount; ++i) {
+            const UserRecord& record = userRecords[i];
+            if (!text(strings, header.stringBytes, record.name, name) ||
+                !text(strings, header.stringBytes, record.userID, userID) ||
+                record.firstLoan + record.loanCount > header.loanCount ||
+                record.patronClass >= LoanPolicyTable::MaxClasses || record.fineCents < 0) {
+                std::cout << "Snapshot has an invalid user record: " << path << "\n";
+                return false;
+            }
+            size_t index = users.add(name, userID);
+            if (index == UserDirectory::NotFound) {
+                std::cout << "Snapshot has a duplicate user ID: " << path << "\n";
+                return false;
+            }
+            User& user = users[index];
+            user.addFines(record.fineCents);
+            user.patronClass = record.patronClass;
+            user.borrowedBooks.reserve(record.loanCount);
+            for (uint32_t j = 0; j < record.loanCount; ++j) {
+                BookHandle handle = BookHandle::fromValue(loans[record.firstLoan + j]);
+                Book* book = inventory.get(handle);
+                if (book == nullptr || book->getAvailability() || book->getBorrower() != Book::NoBorrower) {
+                    std::cout << "Snapshot has a loan of an unknown book: " << path << "\n";
+                    return false;
+                }
+                book->setLoan(user.account, j);
+                user.borrowedBooks.push_back(handle);
+            }
+        }
+
+        // A checked-out copy with no borrower could never be returned
+        for (const Book& book : inventory) {
+            if (!book.getAvailability() && book.getBorrower() == Book::NoBorrower) {
+                std::cout << "Snapshot has a checked-out book with no loan: " << path << "\n";
+                return false;
+            }
+        }
+
+        const HoldRecord* holds = reinterpret_cast<const HoldRecord*>(file.data() + header.holdsOffset);
+        for (uint64_t i = 0; i < header.holdCount; ++i) {
+            Book* book = inventory.get(BookHandle::fromValue(holds[i].book));
+            if (book == nullptr || holds[i].account >= users.size() ||
+                !book->getRecord()->addHold(holds[i].account)) {
+                std::cout << "Snapshot has an invalid hold: " << path << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/*
+ * OpLog Class
+ * Append-only write-ahead log of library mutations. Each mutation is one
+ * fixed 48-byte record, followed by its strings for additions and
+ * registrations, copied into an in-memory group buffer. The group is
+ * handed to the OS when it fills up or on flush(), and fsynced at most
+ * once per sync interval (0 syncs every record), so a durable mutation
+ * costs one buffered append instead of a snapshot rewrite. Recovery loads
+ * the last snapshot and replays every record with a higher sequence number.
+ * Appends are serialized by an internal mutex, which also assigns sequence
+ * numbers, so records reach the file in sequence order from any thread.
+ * With no file open an append only advances the (atomic) sequence
+ */
+class OpLog {
+public:
+    enum class Op : uint8_t {
+        AddBook = 1,   // book = new handle; payload = title, author, ISBN
+        RemoveBook,    // book
+        RegisterUser,  // payload = name, userID
+        Borrow,        // user, book, time
+        Return,        // user, book, time
+        PayFines,      // user, amount (cents)
+        AccrueFines,   // time
+        PlaceHold,     // user, book = any copy of the title, time
+        FillHold,      // user, book = copy handed over, time
+        SetClass,      // user, amount = patron class
+        BorrowBatch,   // user, time, amount = count; payload = the book handles
+        ReturnBatch,   // user, time, amount = count; payload = the book handles
+        RemoveBatch    // amount = count; payload = the book handles
+    };
+
+    struct Record {
+        uint64_t sequence;
+        int64_t time;
+        int64_t amount;         // Cents
+        uint8_t op;
+        uint8_t reserved[3];
+        uint32_t user;
+        uint32_t book;
+        uint32_t payloadLength;
+        uint32_t checksum;      // FNV-1a of the record (with this field zeroed) and payload
+        uint32_t reserved2;
+    };
+
+    static_assert(sizeof(Record) == 48, "op log record layout changed");
+
+private:
+    static const size_t GroupBytes = 1 << 16;
+
+    std::string path;
+    std::atomic<int> fd{-1};  // Read without the lock by append(), to skip it when no file is open
+    std::vector<char> buffer;
+    std::chrono::milliseconds syncInterval{100};
+    std::chrono::steady_clock::time_point lastSync;
+    bool unsynced = false;
+    std::atomic<uint64_t> sequence{0};  // Last sequence number handed out
+    mutable std::mutex lock;
+
+    static uint32_t checksum(const Record& record, const char* payload) {
+        Record copy = record;
+        copy.checksum = 0;
+        uint32_t h = 2166136261u;
+        auto mix = [&h](const char* bytes, size_t size) {
+            for (size_t i = 0; i < size; ++i) {
+                h ^= static_cast<unsigned char>(bytes[i]);
+                h *= 16777619u;
+            }
+        };
+        mix(reinterpret_cast<const char*>(&copy), sizeof(copy));
+        mix(payload, record.payloadLength);
+        return h;
+    }
+
+#ifdef _WIN32
+    static int openFile(const std::string& file) {
+        return _open(file.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+    }
+    static bool writeFile(int file, const char* data, size_t size) {
+        while (size > 0) {
+            int written = _write(file, data, static_cast<unsigned>(std::min<size_t>(size, 1 << 30)));
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+    static void syncFile(int file) { _commit(file); }
+    static void closeFile(int file) { _close(file); }
+    static bool truncateFile(int file, uint64_t size) { return _chsize_s(file, static_cast<long long>(size)) == 0; }
+#else
+    static int openFile(const std::string& file) {
+        return ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    }
+    static bool writeFile(int file, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(file, data, size);
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+    static void syncFile(int file) { ::fsync(file); }
+    static void closeFile(int file) { ::close(file); }
+    static bool truncateFile(int file, uint64_t size) { return ::ftruncate(file, static_cast<off_t>(size)) == 0; }
+#endif
+
+    static void putString(std::vector<char>& out, std::string_view text) {
+        uint32_t length = static_cast<uint32_t>(text.size());
+        const char* bytes = reinterpret_cast<const char*>(&length);
+        out.insert(out.end(), bytes, bytes + sizeof(length));
+        out.insert(out.end(), text.begin(), text.end());
+    }
+
+    // flush() with lock already held
+    void flushLocked(bool forceSync) {
+        if (fd < 0) {
+            return;
+        }
+        if (!buffer.empty()) {
+            if (!writeFile(fd, buffer.data(), buffer.size())) {
+                std::cout << "Write to operation log failed: " << path << "\n";
+            }
+            buffer.clear();
+            unsynced = true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (unsynced && (forceSync || now - lastSync >= syncInterval)) {
+            syncFile(fd);
+            unsynced = false;
+            lastSync = now;
+        }
+    }
+
+public:
+    OpLog() = default;
+    OpLog(const OpLog&) = delete;
+    OpLog& operator=(const OpLog&) = delete;
+    ~OpLog() { close(); }
+
+    bool isOpen() const { return fd >= 0; }
+
+    // Opens (or creates) the log for appending
+    bool open(const std::string& file, std::chrono::milliseconds interval) {
+        close();
+        std::lock_guard<std::mutex> guard(lock);
+        fd = openFile(file);
+        if (fd < 0) {
+            std::cout << "Cannot open operation log: " << file << "\n";
+            return false;
+        }
+        path = file;
+        syncInterval = interval;
+        lastSync = std::chrono::steady_clock::now();
+        buffer.reserve(GroupBytes * 2);
+        return true;
+    }
+
+    uint64_t getSequence() const { return sequence.load(); }
+
+    // Continues numbering after last, e.g. once a snapshot and earlier records are loaded
+    void setSequence(uint64_t last) { sequence.store(last); }
+
+    // Numbers and queues one record; strings are stored after it as length-prefixed payload.
+    // The sequence advances even with no file open, so snapshots stay comparable with later
+    // logs; with no file, that is all an append does, and it takes no lock
+    void append(Op op, uint32_t user, uint32_t book, int64_t time, int64_t amount,
+                std::initializer_list<std::string_view> strings = {}) {
+        if (fd.load(std::memory_order_relaxed) < 0) {
+            sequence.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        uint64_t number = sequence.fetch_add(1) + 1;  // Under the lock, so the file stays in order
+        if (fd < 0) {
+            return;  // Closed meanwhile
+        }
+        size_t start = buffer.size();
+        buffer.resize(start + sizeof(Record));
+        for (std::string_view text : strings) {
+            putString(buffer, text);
+        }
+
+        Record record{};
+        record.sequence = number;
+        record.time = time;
+        record.amount = amount;
+        record.op = static_cast<uint8_t>(op);
+        record.user = user;
+        record.book = book;
+        record.payloadLength = static_cast<uint32_t>(buffer.size() - start - sizeof(Record));
+        record.checksum = checksum(record, buffer.data() + start + sizeof(Record));
+        std::memcpy(buffer.data() + start, &record, sizeof(Record));
+
+        if (buffer.size() >= GroupBytes || syncInterval.count() == 0) {
+            flushLocked(false);
+        }
+    }
+
+    // Hands queued records to the OS, and fsyncs if forced or the interval has elapsed
+    void flush(bool forceSync) {
+        std::lock_guard<std::mutex> guard(lock);
+        flushLocked(forceSync);
+    }
+
+    // Drops every record, once a snapshot has captured their effects
+    bool reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (fd < 0) {
+            return false;
+        }
+        buffer.clear();
+        bool ok = truncateFile(fd, 0);
+        syncFile(fd);
+        unsynced = false;
+        return ok;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (fd >= 0) {
+            flushLocked(true);
+            closeFile(fd);
+            fd = -1;
+        }
+    }
+
+    // Calls apply(record, strings) for every intact record in file, in order.
+    // Reading stops at the first torn or corrupt record, which is where a
+    // crash interrupted the last group; the file is cut back to that point.
+    // Returns false only if the file exists but cannot be read
+    template <typename Apply>
+    static bool replay(const std::string& file, Apply apply) {
+        if (!std::ifstream(file)) {
+            return true;
+        }
+        uint64_t valid = 0;
+        {
+            MappedFile mapped;
+            if (!mapped.open(file)) {
+                std::cout << "Cannot read operation log: " << file << "\n";
+                return false;
+            }
+            std::vector<std::string> strings;
+            while (mapped.size() - valid >= sizeof(Record)) {
+                Record record;
+                std::memcpy(&record, mapped.data() + valid, sizeof(Record));
+                const char* payload = mapped.data() + valid + sizeof(Record);
+                if (record.payloadLength > mapped.size() - valid - sizeof(Record) ||
+                    checksum(record, payload) != record.checksum) {
+                    break;
+                }
+
+                strings.clear();
+                for (uint32_t at = 0; at + sizeof(uint32_t) <= record.payloadLength;) {
+                    uint32_t length;
+                    std::memcpy(&length, payload + at, sizeof(length));
+                    at += sizeof(length);
+                    length = std::min(length, record.payloadLength - at);
+                    strings.emplace_back(payload + at, length);
+                    at += length;
+                }
+                apply(record, strings);
+                valid += sizeof(Record) + record.payloadLength;
+            }
+            if (valid == mapped.size()) {
+                return true;
+            }
+        }
+
+        std::cout << "Operation log has a torn tail; truncating " << file << ".\n";
+        int out = openFile(file);
+        if (out >= 0) {
+            truncateFile(out, valid);
+            closeFile(out);
+        }
+        return true;
+    }
+};
+
+/*
+ * OverdueTracker Class
+ * Min-heaps of (due date, book) entries pushed whenever a loan starts.
+ * collect() pops every entry whose due date has passed, so finding newly
+ * overdue loans costs O(expired log n) instead of a sweep over the whole
+ * inventory. Returned (or re-borrowed) books are not removed from the
+ * heaps; an entry names the book's loan serial, so entries of earlier loans
+ * are recognised and dropped when they surface, even when the same patron
+ * re-borrowed with the same due date. Each loan is reported at most once.
+ * Entries are split over Stripes heaps by ISBN, the same way LibraryService
+ * shards books, so concurrent loans of books in different shards never
+ * share a lock; collect() merges the stripes. Internally synchronized
+ */
+class OverdueTracker {
+public:
+    static const size_t Stripes = 64;
+
+    // A loan that has just become overdue
+    struct Notice {
+        BookHandle book;
+        uint32_t borrower;  // Account (UserDirectory position) holding the book
+        time_t dueDate;
+    };
+
+private:
+    struct Entry {
+        int64_t dueDate;
+        uint32_t book;      // BookHandle value
+        uint32_t loan;      // The book's loan serial when tracked
+        bool operator>(const Entry& other) const { return dueDate > other.dueDate; }
+    };
+
+    // Padded so neighbouring stripes do not share a cache line
+    struct alignas(64) Stripe {
+        std::vector<Entry> heap;
+        std::mutex lock;
+    };
+
+    Stripe stripes[Stripes];
+
+public:
+    // The stripe of a book, by packed ISBN key
+    static size_t stripeOf(uint64_t isbnKey) { return Isbn::hash(isbnKey) % Stripes; }
+
+    // Starts watching a loan; call after the book's due date and borrower are set
+    void track(const Book& book) {
+        Stripe& stripe = stripes[stripeOf(book.getIsbnKey())];
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        stripe.heap.push_back(Entry{static_cast<int64_t>(book.getDueDate()), book.getHandle().getValue(),
+                                    book.getLoanSerial()});
+        std::push_heap(stripe.heap.begin(), stripe.heap.end(), std::greater<Entry>());
+    }
+
+    // Appends a Notice for every tracked loan that is still outstanding and due before now,
+    // in due date order
+    size_t collect(const Inventory& inventory, time_t now, std::vector<Notice>& notices) {
+        size_t first = notices.size();
+        for (Stripe& stripe : stripes) {
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            std::vector<Entry>& heap = stripe.heap;
+            while (!heap.empty() && heap.front().dueDate < static_cast<int64_t>(now)) {
+                Entry entry = heap.front();
+                std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+                heap.pop_back();
+
+                // Skip entries whose loan has ended since it was tracked
+                BookHandle handle = BookHandle::fromValue(entry.book);
+                const Book* book = inventory.get(handle);
+                if (book != nullptr && !book->getAvailability() && book->getLoanSerial() == entry.loan &&
+                    static_cast<int64_t>(book->getDueDate()) == entry.dueDate) {
+                    notices.push_back(Notice{handle, book->getBorrower(), book->getDueDate()});
+                }
+            }
+        }
+        std::stable_sort(notices.begin() + first, notices.end(), [](const Notice& a, const Notice& b) {
+            return a.dueDate < b.dueDate;
+        });
+        return notices.size() - first;
+    }
+
+    // Forgets everything, e.g. before re-tracking the loans of a freshly loaded library
+    void clear() {
+        for (Stripe& stripe : stripes) {
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            stripe.heap.clear();
+        }
+    }
+
+    size_t pending() {
+        size_t count = 0;
+        for (Stripe& stripe : stripes) {
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            count += stripe.heap.size();
+        }
+        return count;
+    }
+};
+
+/*
+ * Library Class
+ * Owns the inventory, users and librarian, and routes every mutation
+ * through one place so it can be recorded in the OpLog. The printing
+ * methods mirror the menu options; replay uses the quiet User cores.
+ * Whenever a copy comes back to the shelf it is handed to the first
+ * patron holding its title, and the hold listener is told
+ */
+class Library {
+public:
+    // A hold that has just been filled: the copy is now checked out to patron
+    struct HoldNotice {
+        BookHandle book;
+        uint32_t patron;  // Account (UserDirectory position) now holding the book
+        time_t dueDate;
+    };
+
+    // Dashboard totals, read from running counters rather than a sweep
+    struct Stats {
+        size_t titles;
+        size_t totalBooks;
+        size_t availableBooks;
+        size_t checkedOutBooks;
+        size_t overdueBooks;
+        int64_t outstandingFineCents;
+        size_t users;
+    };
+
+private:
+    Inventory inventory;
+    UserDirectory users;
+    Librarian librarian;
+    OpLog log;  // Also numbers mutations; the last number is persisted in snapshots
+    OverdueTracker overdue;
+    LoanPolicyTable policies;
+
+    // Loans known to be overdue, for batch accrual; entries of ended loans are dropped lazily
+    struct OverdueLoan {
+        uint32_t book;      // BookHandle value
+        uint32_t loan;      // The book's loan serial when it fell overdue
+        int64_t dueDate;
+    };
+    std::vector<OverdueLoan> overdueLoans;
+    std::vector<int64_t> accrualDue;      // Scratch columns reused by every accrual pass
+    std::vector<int64_t> accrualThrough;
+    std::vector<uint32_t> accrualClass;
+    std::vector<int64_t> accrualCharge;
+    std::function<void(const HoldNotice&)> holdListener;
+    std::shared_ptr<const CatalogView> view;  // Last view captured; the next one shares its unchanged pages
+    std::vector<uint32_t> batchHandles;       // Scratch payload for batch log records
+
+    // Outstanding loans already reported overdue. collectOverdue flags each loan it
+    // counts on its book, so a loan that ends is uncounted only if it was counted, however
+    // the callers' times interleave
+    StatCounter overdueCount;
+
+    // Uncounts book's loan, which has just ended, if it had been counted overdue
+    void loanEnded(Book& book) {
+        if (book.isOverdueCounted()) {
+            book.setOverdueCounted(false);
+            overdueCount.add(-1);
+        }
+    }
+
+    // Position of the first book that would make a batch fail, or books.size() if none
+    // would: every book must be on the shelf (to borrow) or held by the user (to return),
+    // and listed once. Stacks are a handful of books, so the repeat check is a plain scan
+    size_t firstRejected(const User& user, const std::vector<Book*>& books, bool returning) const {
+        for (size_t i = 0; i < books.size(); ++i) {
+            bool usable = returning ? user.holds(books[i]) : books[i]->getAvailability();
+            if (!usable || std::find(books.begin(), books.begin() + i, books[i]) != books.begin() + i) {
+                return i;
+            }
+        }
+        return books.size();
+    }
+
+    // Applies a checked batch without logging it
+    void borrowChecked(size_t userIndex, const std::vector<Book*>& books, time_t now) {
+        User& user = users[userIndex];
+        const LoanPolicy& policy = policyOf(userIndex);
+        for (Book* book : books) {
+            user.tryBorrow(book, now, policy);
+            overdue.track(*book);
+        }
+    }
+
+    int64_t returnChecked(size_t userIndex, const std::vector<Book*>& books, time_t now) {
+        User& user = users[userIndex];
+        const LoanPolicy& policy = policyOf(userIndex);
+        int64_t total = 0;
+        for (Book* book : books) {
+            int64_t fine = 0;
+            user.tryReturn(inventory, book, now, policy, fine);
+            loanEnded(*book);
+            total += fine;
+        }
+        return total;
+    }
+
+    // Logs a batch as one record whose payload is the book handles
+    void logBatch(OpLog::Op op, size_t userIndex, const std::vector<Book*>& books, time_t now) {
+        batchHandles.clear();
+        if (log.isOpen()) {
+            for (const Book* book : books) {
+                batchHandles.push_back(book->getHandle().getValue());
+            }
+        }
+        logHandles(op, userIndex, books.size(), now);
+    }
+
+    void logBatch(OpLog::Op op, size_t userIndex, const std::vector<BookHandle>& handles, time_t now) {
+        batchHandles.clear();
+        if (log.isOpen()) {
+            for (BookHandle handle : handles) {
+                batchHandles.push_back(handle.getValue());
+            }
+        }
+        logHandles(op, userIndex, handles.size(), now);
+    }
+
+    // Appends a batch record of count books whose handles are in batchHandles (left empty
+    // when no log is open; the record then only advances the sequence)
+    void logHandles(OpLog::Op op, size_t userIndex, size_t count, time_t now) {
+        if (!log.isOpen()) {
+            log.append(op, static_cast<uint32_t>(userIndex), 0, now, static_cast<int64_t>(count));
+            return;
+        }
+        log.append(op, static_cast<uint32_t>(userIndex), 0, now, static_cast<int64_t>(count),
+                   {std::string_view(reinterpret_cast<const char*>(batchHandles.data()),
+                                     batchHandles.size() * sizeof(uint32_t))});
+    }
+
+    // Decodes a batch record's payload into handles; false if it does not hold amount of them
+    static bool readHandles(const OpLog::Record& record, const std::vector<std::string>& strings,
+                            std::vector<BookHandle>& handles) {
+        if (strings.size() != 1 || record.amount < 0 ||
+            strings[0].size() != static_cast<uint64_t>(record.amount) * sizeof(uint32_t)) {
+            return false;
+        }
+        handles.resize(static_cast<size_t>(record.amount));
+        for (size_t i = 0; i < handles.size(); ++i) {
+            uint32_t value;
+            std::memcpy(&value, strings[0].data() + i * sizeof(uint32_t), sizeof(value));
+            handles[i] = BookHandle::fromValue(value);
+        }
+        return true;
+    }
+
+    // Replays a batch record: every handle must still resolve and the batch must still pass
+    bool applyBatch(const OpLog::Record& record, const std::vector<std::string>& strings, bool returning) {
+        std::vector<BookHandle> handles;
+        if (record.user >= users.size() || !readHandles(record, strings, handles)) {
+            return false;
+        }
+        std::vector<Book*> books(handles.size());
+        for (size_t i = 0; i < books.size(); ++i) {
+            if ((books[i] = inventory.get(handles[i])) == nullptr) {
+                return false;
+            }
+        }
+        if (firstRejected(users[record.user], books, returning) != books.size()) {
+            return false;
+        }
+        time_t now = static_cast<time_t>(record.time);
+        if (returning) {
+            returnChecked(record.user, books, now);
+        } else {
+            borrowChecked(record.user, books, now);
+        }
+        return true;
+    }
+
+    // Hands shelved copies of record to waiting patrons, oldest hold first; O(1) per copy
+    size_t fillHolds(Title& record, time_t now) {
+        size_t filled = 0;
+        Book* book;
+        while (record.getHoldCount() > 0 && (book = record.anyAvailable()) != nullptr) {
+            uint32_t account = record.nextHold();
+            record.popHold();
+            users[account].tryBorrow(book, now, policyOf(account));  // Cannot fail, the copy is on the shelf
+            log.append(OpLog::Op::FillHold, account, book->getHandle().getValue(), now, 0);
+            overdue.track(*book);
+            if (holdListener) {
+                holdListener(HoldNotice{book->getHandle(), account, book->getDueDate()});
+            }
+            ++filled;
+        }
+        return filled;
+    }
+
+    // Applies one logged mutation during recovery; returns false if it no longer fits the state
+    bool apply(const OpLog::Record& record, const std::vector<std::string>& strings) {
+        BookHandle handle = BookHandle::fromValue(record.book);
+        switch (static_cast<OpLog::Op>(record.op)) {
+            case OpLog::Op::AddBook:
+                return strings.size() == 3 &&
+                       inventory.restore(handle, strings[0], strings[1], strings[2]) != nullptr;
+            case OpLog::Op::RemoveBook: {
+                // Only a shelved copy was ever removed; a loaned one would leave a dangling loan
+                const Book* book = inventory.get(handle);
+                return book != nullptr && book->getAvailability() && inventory.removeCopy(handle);
+            }
+            case OpLog::Op::RegisterUser:
+                return strings.size() == 2 && users.add(strings[0], strings[1]) != UserDirectory::NotFound;
+            case OpLog::Op::Borrow: {
+                Book* book = inventory.get(handle);
+                if (record.user >= users.size() || book == nullptr ||
+                    users[record.user].tryBorrow(book, static_cast<time_t>(record.time),
+                                                 policyOf(record.user)) != LoanResult::Ok) {
+                    return false;
+                }
+                overdue.track(*book);  // Replayed accruals must see the same overdue loans
+                return true;
+            }
+            case OpLog::Op::Return: {
+                Book* book = inventory.get(handle);
+                int64_t fine = 0;
+                if (record.user >= users.size() || book == nullptr) {
+                    return false;
+                }
+                if (users[record.user].tryReturn(inventory, book, static_cast<time_t>(record.time),
+                                                 policyOf(record.user), fine) != LoanResult::Ok) {
+                    return false;
+                }
+                loanEnded(*book);
+                return true;
+            }
+            case OpLog::Op::PayFines:
+                return record.user < users.size() &&
+                       users[record.user].tryPayFines(record.amount) == LoanResult::Ok;
+            case OpLog::Op::AccrueFines: {
+                int64_t total = 0;
+                accrue(static_cast<time_t>(record.time), total);
+                return total == record.amount;
+            }
+            case OpLog::Op::PlaceHold: {
+                // Only queue; the handovers that followed were logged as FillHold
+                Book* book = inventory.get(handle);
+                return record.user < users.size() && book != nullptr &&
+                       book->getRecord()->addHold(record.user);
+            }
+            case OpLog::Op::FillHold: {
+                Book* book = inventory.get(handle);
+                if (record.user >= users.size() || book == nullptr ||
+                    book->getRecord()->nextHold() != record.user) {
+                    return false;
+                }
+                book->getRecord()->popHold();
+                if (users[record.user].tryBorrow(book, static_cast<time_t>(record.time),
+                                                 policyOf(record.user)) != LoanResult::Ok) {
+                    return false;
+                }
+                overdue.track(*book);
+                return true;
+            }
+            case OpLog::Op::BorrowBatch:
+                return applyBatch(record, strings, false);
+            case OpLog::Op::ReturnBatch:
+                return applyBatch(record, strings, true);
+            case OpLog::Op::RemoveBatch: {
+                // Every copy must still be held and shelved, as when it was removed
+                std::vector<BookHandle> handles, removed;
+                if (!readHandles(record, strings, handles)) {
+                    return false;
+                }
+                for (BookHandle handle : handles) {
+                    const Book* book = inventory.get(handle);
+                    if (book == nullptr || !book->getAvailability()) {
+                        return false;
+                    }
+                }
+                return inventory.removeCopies(handles, removed) == handles.size();
+            }
+            case OpLog::Op::SetClass:
+                if (record.user >= users.size() || record.amount < 0 ||
+                    record.amount >= static_cast<int64_t>(LoanPolicyTable::MaxClasses)) {
+                    return false;
+                }
+                users[record.user].setPatronClass(static_cast<uint32_t>(record.amount));
+                return true;
+        }
+        return false;
+    }
+
+    // Starts tracking every outstanding loan, after the state has been loaded or replayed
+    void trackAllLoans() {
+        overdue.clear();
+        overdueLoans.clear();
+        overdueCount.add(-overdueCount.get());
+        for (const Book& book : inventory) {
+            inventory.get(book.getHandle())->setOverdueCounted(false);
+            if (!book.getAvailability()) {
+                overdue.track(book);
+            }
+        }
+    }
+
+public:
+    // Filled holds wait on the patron's record for announceHolds until another listener is set
+    explicit Library(const Librarian& librarian) : librarian(librarian) {
+        holdListener = [this](const HoldNotice& notice) { users[notice.patron].addReadyHold(notice.book); };
+    }
+    Library(const Library&) = delete;
+    Library& operator=(const Library&) = delete;
+
+    Inventory& getInventory() { return inventory; }
+    const Inventory& getInventory() const { return inventory; }
+    UserDirectory& getUsers() { return users; }
+    const UserDirectory& getUsers() const { return users; }
+
+    // Resolves a patron by userID; returns UserDirectory::NotFound if unknown
+    size_t findUser(const std::string& userID) const { return users.indexOf(userID); }
+    Librarian& getLibrarian() { return librarian; }
+
+    // Loads the snapshot at snapshotPath (if present) and replays logPath on top of it
+    bool recover(const std::string& snapshotPath, const std::string& logPath) {
+        uint64_t sequence = 0;
+        if (!snapshotPath.empty() && std::ifstream(snapshotPath)) {
+            if (!Snapshot::load(snapshotPath, inventory, users, sequence)) {
+                return false;
+            }
+        }
+        log.setSequence(sequence);
+        trackAllLoans();
+        if (logPath.empty()) {
+            return true;
+        }
+
+        size_t replayed = 0, rejected = 0;
+        bool ok = OpLog::replay(logPath, [&](const OpLog::Record& record, const std::vector<std::string>& strings) {
+            if (record.sequence <= sequence) {
+                return;  // Already captured by the snapshot
+            }
+            sequence = record.sequence;
+            if (apply(record, strings)) {
+                ++replayed;
+            } else {
+                ++rejected;
+            }
+        });
+        inventory.rebuildFreeList();
+        log.setSequence(sequence);
+        if (replayed + rejected > 0) {
+            std::cout << "Replayed " << replayed << " logged operations from " << logPath;
+            if (rejected > 0) {
+                std::cout << " (" << rejected << " could not be applied)";
+            }
+            std::cout << ".\n";
+        }
+        return ok;
+    }
+
+    // Starts recording mutations to logPath
+    bool openLog(const std::string& logPath, std::chrono::milliseconds syncInterval) {
+        return log.open(logPath, syncInterval);
+    }
+
+    // Hands pending log records to the OS (called between interactive commands)
+    void flushLog() { log.flush(false); }
+
+    // Writes a snapshot and, since it now covers everything logged, empties the log
+    bool saveSnapshot(const std::string& path) {
+        log.flush(true);
+        if (!Snapshot::save(path, inventory, users, log.getSequence())) {
+            return false;
+        }
+        log.reset();
+        return true;
+    }
+
+    void addBook(const std::string& title, const std::string& author, const std::string& ISBN) {
+        BookHandle handle = librarian.addBook(inventory, title, author, ISBN);
+        if (handle.isValid()) {
+            log.append(OpLog::Op::AddBook, 0, handle.getValue(), 0, 0, {title, author, ISBN});
+            fillHolds(*inventory.get(handle)->getRecord(), time(0));  // A new copy may have someone waiting
+        }
+    }
+
+    template <typename Range>
+    void addBooks(const Range& records) {
+        size_t start = inventory.size();
+        librarian.addBooks(inventory, records);
+        if (log.isOpen()) {
+            for (size_t i = start; i < inventory.size(); ++i) {
+                const Book& book = inventory[i];
+                log.append(OpLog::Op::AddBook, 0, book.getHandle().getValue(), 0, 0,
+                           {book.getTitle(), book.getAuthor(), book.getISBN()});
+            }
+        }
+    }
+
+    void removeBook(const std::string& ISBN) {
+        BookHandle handle = librarian.removeBook(inventory, ISBN);
+        if (handle.isValid()) {
+            log.append(OpLog::Op::RemoveBook, 0, handle.getValue(), 0, 0);
+        }
+    }
+
+    // Weeds every shelved copy of a set of ISBNs in one pass, logged as one record
+    void removeBooks(const std::vector<std::string>& ISBNs) {
+        std::vector<BookHandle> removed;
+        if (librarian.removeBooks(inventory, ISBNs, removed) > 0) {
+            logBatch(OpLog::Op::RemoveBatch, 0, removed, 0);
+        }
+    }
+
+    bool registerUser(const std::string& name, const std::string& userID) {
+        if (users.add(name, userID) == UserDirectory::NotFound) {
+            std::cout << "User ID already registered: " << userID << "\n";
+            return false;
+        }
+        log.append(OpLog::Op::RegisterUser, 0, 0, 0, 0, {name, userID});
+        std::cout << "User registered successfully.\n";
+        return true;
+    }
+
+    // Quiet circulation cores: apply and log, leaving the reporting to the caller.
+    // Thread safety is the caller's concern (see LibraryService)
+    LoanResult borrow(size_t userIndex, Book* book, time_t now) {
+        LoanResult result = users[userIndex].tryBorrow(book, now, policyOf(userIndex));
+        if (result == LoanResult::Ok) {
+            log.append(OpLog::Op::Borrow, static_cast<uint32_t>(userIndex), book->getHandle().getValue(), now, 0);
+            overdue.track(*book);
+        }
+        return result;
+    }
+
+    LoanResult giveBack(size_t userIndex, Book* book, time_t now, int64_t& fine) {
+        LoanResult result = users[userIndex].tryReturn(inventory, book, now, policyOf(userIndex), fine);
+        if (result == LoanResult::Ok) {
+            loanEnded(*book);
+            log.append(OpLog::Op::Return, static_cast<uint32_t>(userIndex), book->getHandle().getValue(), now, 0);
+            fillHolds(*book->getRecord(), now);
+        }
+        return result;
+    }
+
+    // Queues the user for the next copy of book's title, handing one over at once if any is shelved
+    LoanResult hold(size_t userIndex, Book* book, time_t now) {
+        uint32_t account = static_cast<uint32_t>(userIndex);
+        Title& record = *book->getRecord();
+        if (!record.addHold(account)) {
+            return LoanResult::AlreadyWaiting;
+        }
+        log.append(OpLog::Op::PlaceHold, account, book->getHandle().getValue(), now, 0);
+        fillHolds(record, now);
+        return LoanResult::Ok;
+    }
+
+    // Finds a distinct copy for each ISBN in one lookup pass: a shelved copy to borrow, or
+    // one the user holds to return. On failure, failed receives the position of the first
+    // ISBN that has no copy left to pick
+    LoanResult pickCopies(size_t userIndex, const std::vector<std::string>& ISBNs, bool returning,
+                          std::vector<Book*>& books, size_t& failed) {
+        books.clear();
+        books.reserve(ISBNs.size());
+        const User& user = users[userIndex];
+        for (size_t i = 0; i < ISBNs.size(); ++i) {
+            uint64_t key = Isbn::parse(ISBNs[i]);
+            Title* record = inventory.findTitleKey(key);
+            Book* picked = nullptr;
+            if (record == nullptr) {
+                failed = i;
+                return LoanResult::NoSuchBook;
+            }
+            if (returning) {
+                for (BookHandle handle : user.getBorrowedBooks()) {
+                    Book* book = inventory.get(handle);  // A stale loan entry matches nothing
+                    if (book != nullptr && book->getRecord() == record && std::find(books.begin(), books.end(), book) == books.end()) {
+                        picked = book;
+                        break;
+                    }
+                }
+            } else {
+                size_t taken = static_cast<size_t>(std::count_if(books.begin(), books.end(), [record](const Book* book) {
+                    return book->getRecord() == record;
+                }));
+                picked = taken < record->getAvailableCount() ? record->availableCopy(taken) : nullptr;
+            }
+            if (picked == nullptr) {
+                failed = i;
+                return returning ? LoanResult::NotBorrowed : LoanResult::NotAvailable;
+            }
+            books.push_back(picked);
+        }
+        return LoanResult::Ok;
+    }
+
+    // Borrows every book in books for the user, or none of them, and logs the batch as one
+    // record. On failure, failed receives the position of the first book that prevented it
+    LoanResult borrowAll(size_t userIndex, const std::vector<Book*>& books, time_t now, size_t& failed) {
+        failed = firstRejected(users[userIndex], books, false);
+        if (failed != books.size()) {
+            return LoanResult::NotAvailable;
+        }
+        if (!books.empty()) {
+            borrowChecked(userIndex, books, now);
+            logBatch(OpLog::Op::BorrowBatch, userIndex, books, now);
+        }
+        return LoanResult::Ok;
+    }
+
+    // Returns every book in books, or none of them, like borrowAll; fine receives the
+    // total charged. Waiting patrons get the returned copies afterwards
+    LoanResult giveBackAll(size_t userIndex, const std::vector<Book*>& books, time_t now,
+                           int64_t& fine, size_t& failed) {
+        fine = 0;
+        failed = firstRejected(users[userIndex], books, true);
+        if (failed != books.size()) {
+            return LoanResult::NotBorrowed;
+        }
+        if (!books.empty()) {
+            fine = returnChecked(userIndex, books, now);
+            logBatch(OpLog::Op::ReturnBatch, userIndex, books, now);
+            for (Book* book : books) {
+                fillHolds(*book->getRecord(), now);
+            }
+        }
+        return LoanResult::Ok;
+    }
+
+    // Captures a point-in-time view for reports, copying only the pages written since
+    // the last one. Nothing may write to the library while this runs (LibraryService
+    // holds every shard lock), but the view can then be read from any thread, for as
+    // long as it is held, without locks
+    std::shared_ptr<const CatalogView> captureView() {
+        view = CatalogView::capture(inventory, users, view.get());
+        return view;
+    }
+
+    // Replaces the hold listener; it runs wherever a hold is filled, including under
+    // LibraryService's shard locks, so it should only record or queue the notice
+    void setHoldListener(std::function<void(const HoldNotice&)> listener) { holdListener = std::move(listener); }
+
+    // Prints the holds filled for a patron since they last heard, skipping copies that
+    // have since gone back; returns the number printed. Call from the patron's own
+    // session (the default listener only queues), never under LibraryService's locks
+    size_t announceHolds(size_t userIndex) {
+        User& user = users[userIndex];
+        std::vector<BookHandle> ready;
+        user.takeReadyHolds(ready);
+        size_t shown = 0;
+        for (BookHandle handle : ready) {
+            const Book* book = inventory.get(handle);
+            if (book == nullptr || book->getBorrower() != user.getAccount()) {
+                continue;
+            }
+            std::cout << "Hold ready: " << book->getTitle() << " (ISBN " << book->getISBN()
+                      << ") is now checked out to " << user.getName() << " (ID " << user.getUserID() << ").\n";
+            ++shown;
+        }
+        return shown;
+    }
+
+    // Moves a user to another patron class; returns false if there is no such class
+    bool setPatronClass(size_t userIndex, uint32_t patronClass) {
+        if (patronClass >= LoanPolicyTable::MaxClasses) {
+            return false;
+        }
+        users[userIndex].setPatronClass(patronClass);
+        log.append(OpLog::Op::SetClass, static_cast<uint32_t>(userIndex), 0, 0, patronClass);
+        return true;
+    }
+
+    LoanResult pay(size_t userIndex, int64_t cents) {
+        LoanResult result = users[userIndex].tryPayFines(cents);
+        if (result == LoanResult::Ok) {
+            log.append(OpLog::Op::PayFines, static_cast<uint32_t>(userIndex), 0, 0, cents);
+        }
+        return result;
+    }
+
+    // The loan rules of a patron class, and of a user through their class
+    const LoanPolicy& getLoanPolicy(uint32_t patronClass) const { return policies[patronClass]; }
+    const LoanPolicy& policyOf(size_t userIndex) const { return policies[users[userIndex].getPatronClass()]; }
+
+    // Replaces the rules of a patron class; replay applies the current policies, so keep
+    // them stable across restarts. Returns false if the class or policy is not valid
+    bool setLoanPolicy(uint32_t patronClass, const LoanPolicy& policy) { return policies.set(patronClass, policy); }
+
+    // Loans that became overdue since the last call, without sweeping the inventory
+    size_t collectOverdue(time_t now, std::vector<OverdueTracker::Notice>& notices) {
+        size_t start = notices.size();
+        size_t found = overdue.collect(inventory, now, notices);
+        for (size_t i = start; i < notices.size(); ++i) {
+            Book* book = inventory.get(notices[i].book);
+            book->setOverdueCounted(true);
+            overdueLoans.push_back(OverdueLoan{notices[i].book.getValue(), book->getLoanSerial(),
+                                               static_cast<int64_t>(notices[i].dueDate)});
+        }
+        overdueCount.add(static_cast<int64_t>(found));
+        return found;
+    }
+
+    // Charges every overdue loan for the complete fine periods elapsed up to now, under
+    // its borrower's policy, in one batch: gather the still-outstanding loans into
+    // contiguous columns, compute all charges in a branch-free loop, then scatter them to
+    // books and patrons. Returns the number of loans charged; total receives the cents charged
+    size_t accrue(time_t now, int64_t& total) {
+        std::vector<OverdueTracker::Notice> notices;
+        collectOverdue(now, notices);
+
+        // Gather, compacting away loans that ended since they became overdue
+        accrualDue.clear();
+        accrualThrough.clear();
+        accrualClass.clear();
+        size_t kept = 0;
+        for (const OverdueLoan& loan : overdueLoans) {
+            const Book* book = inventory.get(BookHandle::fromValue(loan.book));
+            if (book != nullptr && !book->getAvailability() && book->getLoanSerial() == loan.loan &&
+                static_cast<int64_t>(book->getDueDate()) == loan.dueDate) {
+                overdueLoans[kept++] = loan;
+                accrualDue.push_back(loan.dueDate);
+                accrualThrough.push_back(static_cast<int64_t>(book->getAccruedThrough()));
+                accrualClass.push_back(users[book->getBorrower()].getPatronClass());
+            }
+        }
+        overdueLoans.resize(kept);
+        accrualCharge.resize(kept);
+
+        // Compute; a loan is charged up to now, less what it had been charged through
+        // its last accrual, so a cap is never crossed
+        const int64_t end = static_cast<int64_t>(now);
+        const int64_t* due = accrualDue.data();
+        const uint32_t* patronClass = accrualClass.data();
+        int64_t* through = accrualThrough.data();
+        int64_t* charge = accrualCharge.data();
+        for (size_t i = 0; i < kept; ++i) {
+            const LoanPolicy& policy = policies[patronClass[i]];
+            charge[i] = std::max<int64_t>(lateFine(policy, due[i], end) - lateFine(policy, due[i], through[i]), 0);
+            through[i] = std::max(through[i], end);
+        }
+
+        // Scatter
+        size_t charged = 0;
+        total = 0;
+        for (size_t i = 0; i < kept; ++i) {
+            if (charge[i] != 0) {
+                Book* book = inventory.get(BookHandle::fromValue(overdueLoans[i].book));
+                book->setAccruedThrough(static_cast<time_t>(through[i]));
+                users[book->getBorrower()].chargeFine(charge[i]);
+                total += charge[i];
+                ++charged;
+            }
+        }
+        if (charged > 0) {
+            log.append(OpLog::Op::AccrueFines, 0, 0, end, total);
+        }
+        return charged;
+    }
+
+    // Runs a batch accrual and prints the total
+    void accrueFines(time_t now) {
+        int64_t total = 0;
+        size_t charged = accrue(now, total);
+        std::cout << "Accrued $" << formatCents(total) << " in fines across " << charged << " overdue loans.\n";
+    }
+
+    // Current totals. Only the loans that fell overdue since the last collection are
+    // visited; everything else is O(1)
+    Stats getStats(time_t now) {
+        std::vector<OverdueTracker::Notice> notices;
+        collectOverdue(now, notices);
+        Stats stats;
+        stats.titles = inventory.titleCount();
+        stats.totalBooks = inventory.size();
+        stats.availableBooks = inventory.availableCount();
+        stats.checkedOutBooks = stats.totalBooks - stats.availableBooks;
+        stats.overdueBooks = static_cast<size_t>(std::max<int64_t>(overdueCount.get(), 0));
+        stats.outstandingFineCents = users.outstandingFineCents();
+        stats.users = users.size();
+        return stats;
+    }
+
+    // Prints the current totals
+    void displayStats(time_t now) {
+        Stats stats = getStats(now);
+        std::cout << "Titles: " << stats.titles << "\nBooks: " << stats.totalBooks
+                  << " (" << stats.availableBooks << " available, " << stats.checkedOutBooks
+                  << " checked out, " << stats.overdueBooks << " overdue)\nUsers: " << stats.users
+                  << "\nOutstanding fines: $" << formatCents(stats.outstandingFineCents) << "\n";
+    }
+
+    // Prints a notice for every loan that became overdue since the last call
+    void reportOverdue(time_t now) {
+        std::vector<OverdueTracker::Notice> notices;
+        collectOverdue(now, notices);
+        for (const OverdueTracker::Notice& notice : notices) {
+            const Book* book = inventory.get(notice.book);
+            const User& user = users[notice.borrower];
+            std::cout << "Overdue: " << book->getTitle() << " (ISBN " << book->getISBN() << ") held by "
+                      << user.getName() << " (ID " << user.getUserID() << "), due "
+                      << static_cast<long long>(difftime(now, notice.dueDate)) << " seconds ago\n";
+        }
+        std::cout << notices.size() << " newly overdue loans.\n";
+    }
+
+    // Borrows the book, or if every copy is out queues the user for the next one
+    void borrowBook(size_t userIndex, Book* book) {
+        time_t now = time(0);
+        if (users[userIndex].borrowBook(book, now, policyOf(userIndex))) {
+            log.append(OpLog::Op::Borrow, static_cast<uint32_t>(userIndex),
+                       book->getHandle().getValue(), now, 0);
+            overdue.track(*book);
+            return;
+        }
+        LoanResult result = hold(userIndex, book, now);
+        const Title& record = *book->getRecord();
+        size_t position = record.holdPosition(static_cast<uint32_t>(userIndex));
+        if (position != Title::NoHold) {
+            std::cout << (result == LoanResult::Ok ? "Placed a hold" : "Already waiting")
+                      << ", number " << position + 1 << " of " << record.getHoldCount()
+                      << " in line for this title.\n";
+        }
+    }
+
+    // Checks out a whole stack for one user, or nothing, with one summary line
+    void borrowBooks(size_t userIndex, const std::vector<std::string>& ISBNs) {
+        time_t now = time(0);
+        std::vector<Book*> books;
+        size_t failed = 0;
+        LoanResult result = pickCopies(userIndex, ISBNs, false, books, failed);
+        if (result == LoanResult::Ok) {
+            result = borrowAll(userIndex, books, now, failed);
+        }
+        if (result == LoanResult::NoSuchBook) {
+            std::cout << "No books borrowed: " << ISBNs[failed] << " is not in the inventory.\n";
+        } else if (result != LoanResult::Ok) {
+            std::cout << "No books borrowed: " << ISBNs[failed] << " is not available.\n";
+        } else {
+            std::cout << books.size() << " books borrowed successfully.\n";
+        }
+    }
+
+    // Returns a whole stack for one user, or nothing, with one summary line
+    void returnBooks(size_t userIndex, const std::vector<std::string>& ISBNs) {
+        time_t now = time(0);
+        std::vector<Book*> books;
+        size_t failed = 0;
+        int64_t fine = 0;
+        LoanResult result = pickCopies(userIndex, ISBNs, true, books, failed);
+        if (result == LoanResult::Ok) {
+            result = giveBackAll(userIndex, books, now, fine, failed);
+        }
+        if (result == LoanResult::NoSuchBook) {
+            std::cout << "No books returned: " << ISBNs[failed] << " is not in the inventory.\n";
+        } else if (result != LoanResult::Ok) {
+            std::cout << "No books returned: you didn't borrow " << ISBNs[failed] << ".\n";
+        } else {
+            if (fine > 0) {
+                std::cout << "Books returned late. Fine added: $" << formatCents(fine) << "\n";
+            }
+            std::cout << books.size() << " books returned successfully.\n";
+        }
+    }
+
+    void returnBook(size_t userIndex, Book* book) {
+        time_t now = time(0);
+        if (users[userIndex].returnBook(inventory, book, now, policyOf(userIndex))) {
+            loanEnded(*book);
+            log.append(OpLog::Op::Return, static_cast<uint32_t>(userIndex),
+                       book->getHandle().getValue(), now, 0);
+            fillHolds(*book->getRecord(), now);
+        }
+    }
+
+    void payFines(size_t userIndex, double amount) {
+        int64_t before = users[userIndex].getFineCents();
+        if (users[userIndex].payFines(amount)) {
+            log.append(OpLog::Op::PayFines, static_cast<uint32_t>(userIndex), 0, 0,
+                       before - users[userIndex].getFineCents());
+        }
+    }
+};
+
+/*
+ * LibraryService Class
+ * Thread-safe front end to a Library for many circulation desks at once.
+ * Books and users are sharded by hash of ISBN / userID over a fixed set of
+ * shard locks. A circulation call locks only the shards of its book and
+ * its user (in index order, so threads never deadlock), meaning calls on
+ * different books and patrons proceed in parallel. Catalog and
+ * registration changes, which rewrite the shared indexes, lock every
+ * shard. Availability is only checked and flipped under the book's shard
+ * lock, so two threads can never borrow the same Book. A loan list and the
+ * loan back-references of its books belong to the user's shard. A title's
+ * hold queue belongs to its book shard; a return that hands the copy to a
+ * waiting patron also holds that patron's shard
+ */
+class LibraryService {
+private:
+    static const size_t ShardCount = 64;
+    static_assert(ShardCount == OverdueTracker::Stripes, "a book shard must map onto one overdue stripe");
+
+    // Padded so neighbouring shard locks do not share a cache line
+    struct alignas(64) Shard {
+        std::mutex lock;
+    };
+
+    Library& library;
+    Shard shards[ShardCount];
+
+    static size_t shardOf(std::string_view userID) { return HashIndex::hashString(userID) % ShardCount; }
+
+    // Books shard by packed key, so every spelling of an ISBN takes the same lock
+    static size_t bookShardOf(const std::string& ISBN) { return Isbn::hash(Isbn::parse(ISBN)) % ShardCount; }
+
+    static const size_t NoShard = ShardCount;
+
+    // Holds the shard locks of one book, one user and optionally a waiting patron, taken in index order
+    class CirculationLock {
+    private:
+        std::unique_lock<std::mutex> locks[3];
+
+    public:
+        CirculationLock(Shard* shards, size_t book, size_t user, size_t waiting = NoShard) {
+            size_t order[3] = {book, user, waiting};
+            std::sort(order, order + 3);
+            for (size_t i = 0; i < 3 && order[i] != NoShard; ++i) {
+                if (i == 0 || order[i] != order[i - 1]) {
+                    locks[i] = std::unique_lock<std::mutex>(shards[order[i]].lock);
+                }
+            }
+        }
+    };
+
+    // Holds the shard locks of a batch, taken once each in index order
+    class ShardSetLock {
+    private:
+        Shard* shards;
+        std::vector<size_t> order;
+
+    public:
+        ShardSetLock(Shard* shards, const std::vector<size_t>& shardIndexes) : shards(shards), order(shardIndexes) {
+            std::sort(order.begin(), order.end());
+            order.erase(std::unique(order.begin(), order.end()), order.end());
+            for (size_t shard : order) {
+                shards[shard].lock.lock();
+            }
+        }
+        ~ShardSetLock() {
+            for (size_t i = order.size(); i-- > 0;) {
+                shards[order[i]].lock.unlock();
+            }
+        }
+        ShardSetLock(const ShardSetLock&) = delete;
+        ShardSetLock& operator=(const ShardSetLock&) = delete;
+    };
+
+    // Holds every shard lock, for changes to the shared indexes
+    class ExclusiveLock {
+    private:
+        Shard* shards;
+
+    public:
+        explicit ExclusiveLock(Shard* shards) : shards(shards) {
+            for (size_t i = 0; i < ShardCount; ++i) {
+                shards[i].lock.lock();
+            }
+        }
+        ~ExclusiveLock() {
+            for (size_t i = ShardCount; i-- > 0;) {
+                shards[i].lock.unlock();
+            }
+        }
+        ExclusiveLock(const ExclusiveLock&) = delete;
+        ExclusiveLock& operator=(const ExclusiveLock&) = delete;
+    };
+
+    // Resolves both keys under the caller's shard locks; for a return, to the copy the user holds
+    LoanResult resolve(const std::string& userID, const std::string& ISBN, bool held,
+                       size_t& userIndex, Book*& book) {
+        userIndex = library.findUser(userID);
+        if (userIndex == UserDirectory::NotFound) {
+            return LoanResult::NoSuchUser;
+        }
+        Inventory& inventory = library.getInventory();
+        book = held ? library.getUsers()[userIndex].loanOf(inventory, Isbn::parse(ISBN)) : nullptr;
+        if (book == nullptr) {
+            book = inventory.find(ISBN);
+        }
+        return book != nullptr ? LoanResult::Ok : LoanResult::NoSuchBook;
+    }
+
+public:
+    explicit LibraryService(Library& library) : library(library) {}
+    LibraryService(const LibraryService&) = delete;
+    LibraryService& operator=(const LibraryService&) = delete;
+
+    LoanResult borrow(const std::string& userID, const std::string& ISBN, time_t now) {
+        CirculationLock guard(shards, bookShardOf(ISBN), shardOf(userID));
+        size_t userIndex;
+        Book* book;
+        LoanResult result = resolve(userID, ISBN, false, userIndex, book);
+        return result == LoanResult::Ok ? library.borrow(userIndex, book, now) : result;
+    }
+
+    // Returns the user's copy; if a patron is waiting, their shard is locked too before the handover
+    LoanResult giveBack(const std::string& userID, const std::string& ISBN, time_t now, int64_t& fine) {
+        size_t bookShard = bookShardOf(ISBN), userShard = shardOf(userID), waiting = NoShard;
+        for (;;) {
+            CirculationLock guard(shards, bookShard, userShard, waiting);
+            size_t userIndex;
+            Book* book;
+            LoanResult result = resolve(userID, ISBN, true, userIndex, book);
+            if (result != LoanResult::Ok) {
+                return result;
+            }
+            uint32_t next = book->getRecord()->nextHold();
+            size_t needed = next != Title::NoHold ? shardOf(library.getUsers()[next].getUserID()) : NoShard;
+            if (needed == NoShard || needed == bookShard || needed == userShard || needed == waiting) {
+                return library.giveBack(userIndex, book, now, fine);
+            }
+            waiting = needed;  // The queue changed or was not locked for; retry holding that shard too
+        }
+    }
+
+    // Borrows one copy per ISBN for the user, or none (see Library::borrowAll), taking the
+    // user's and every book's shard lock once for the whole stack
+    LoanResult borrowAll(const std::string& userID, const std::vector<std::string>& ISBNs, time_t now,
+                         size_t& failed) {
+        std::vector<size_t> locked;
+        locked.reserve(ISBNs.size() * 2 + 1);
+        locked.push_back(shardOf(userID));
+        for (const std::string& ISBN : ISBNs) {
+            locked.push_back(bookShardOf(ISBN));
+        }
+        ShardSetLock guard(shards, locked);
+        size_t userIndex = library.findUser(userID);
+        if (userIndex == UserDirectory::NotFound) {
+            return LoanResult::NoSuchUser;
+        }
+        std::vector<Book*> books;
+        LoanResult result = library.pickCopies(userIndex, ISBNs, false, books, failed);
+        return result == LoanResult::Ok ? library.borrowAll(userIndex, books, now, failed) : result;
+    }
+
+    // Returns the user's copies of a stack of ISBNs, or none. Like giveBack, the shards of
+    // the patrons first in line for the returned titles are locked too, retrying if the
+    // queues named someone not yet locked
+    LoanResult giveBackAll(const std::string& userID, const std::vector<std::string>& ISBNs, time_t now,
+                           int64_t& fine, size_t& failed) {
+        std::vector<size_t> locked;
+        locked.reserve(ISBNs.size() * 2 + 1);
+        locked.push_back(shardOf(userID));
+        for (const std::string& ISBN : ISBNs) {
+            locked.push_back(bookShardOf(ISBN));
+        }
+        std::vector<Book*> books;
+        for (;;) {
+            ShardSetLock guard(shards, locked);
+            size_t userIndex = library.findUser(userID);
+            if (userIndex == UserDirectory::NotFound) {
+                return LoanResult::NoSuchUser;
+            }
+            LoanResult result = library.pickCopies(userIndex, ISBNs, true, books, failed);
+            if (result != LoanResult::Ok) {
+                return result;
+            }
+
+            // Each returned copy of a title goes to the next patron still waiting for it
+            size_t known = locked.size();
+            for (size_t i = 0; i < books.size(); ++i) {
+                const Title* record = books[i]->getRecord();
+                size_t earlier = static_cast<size_t>(std::count_if(books.begin(), books.begin() + i,
+                                                                   [record](const Book* book) {
+                    return book->getRecord() == record;
+                }));
+                if (earlier < record->getHoldCount()) {
+                    size_t needed = shardOf(library.getUsers()[record->getHolds()[earlier]].getUserID());
+                    if (std::find(locked.begin(), locked.end(), needed) == locked.end()) {
+                        locked.push_back(needed);
+                    }
+                }
+            }
+            if (locked.size() == known) {
+                return library.giveBackAll(userIndex, books, now, fine, failed);
+            }
+        }
+    }
+
+    // Queues the user for the next copy of ISBN (handed over at once if one is on the shelf)
+    LoanResult placeHold(const std::string& userID, const std::string& ISBN, time_t now) {
+        CirculationLock guard(shards, bookShardOf(ISBN), shardOf(userID));
+        size_t userIndex;
+        Book* book;
+        LoanResult result = resolve(userID, ISBN, false, userIndex, book);
+        return result == LoanResult::Ok ? library.hold(userIndex, book, now) : result;
+    }
+
+    LoanResult pay(const std::string& userID, int64_t cents) {
+        std::lock_guard<std::mutex> guard(shards[shardOf(userID)].lock);
+        size_t userIndex = library.findUser(userID);
+        return userIndex != UserDirectory::NotFound ? library.pay(userIndex, cents) : LoanResult::NoSuchUser;
+    }
+
+    // Hands over the holds filled for the user since the last call, for the caller to
+    // report once the shard lock is released
+    bool takeReadyHolds(const std::string& userID, std::vector<BookHandle>& ready) {
+        std::lock_guard<std::mutex> guard(shards[shardOf(userID)].lock);
+        size_t userIndex = library.findUser(userID);
+        if (userIndex == UserDirectory::NotFound) {
+            return false;
+        }
+        library.getUsers()[userIndex].takeReadyHolds(ready);
+        return true;
+    }
+
+    // Snapshot of one patron's fines (in cents) and loan count
+    bool lookupUser(const std::string& userID, int64_t& fineCents, size_t& loans) {
+        std::lock_guard<std::mutex> guard(shards[shardOf(userID)].lock);
+        const User* user = library.getUsers().find(userID);
+        if (user == nullptr) {
+            return false;
+        }
+        fineCents = user->getFineCents();
+        loans = user->getBorrowedBooks().size();
+        return true;
+    }
+
+    // Snapshot of one title's copies, shelved copies and hold queue length; false if not held
+    bool lookupTitle(const std::string& ISBN, size_t& copies, size_t& available, size_t& waiting) {
+        std::lock_guard<std::mutex> guard(shards[bookShardOf(ISBN)].lock);
+        const Title* record = library.getInventory().findTitle(ISBN);
+        if (record == nullptr) {
+            return false;
+        }
+        copies = record->getCopyCount();
+        available = record->getAvailableCount();
+        waiting = record->getHoldCount();
+        return true;
+    }
+
+    bool isAvailable(const std::string& ISBN) {
+        std::lock_guard<std::mutex> guard(shards[bookShardOf(ISBN)].lock);
+        const Title* record = library.getInventory().findTitle(ISBN);
+        return record != nullptr && record->getAvailableCount() > 0;
+    }
+
+    // Dashboard totals; briefly holds every shard so the counters agree with each other
+    Library::Stats stats(time_t now) {
+        ExclusiveLock guard(shards);
+        return library.getStats(now);
+    }
+
+    // Point-in-time view for reports. Circulation waits only while the pages changed
+    // since the last view are copied, never while the report runs
+    std::shared_ptr<const CatalogView> report() {
+        ExclusiveLock guard(shards);
+        return library.captureView();
+    }
+
+    // Catalog and registration changes; these print like their Library counterparts
+    void addBook(const std::string& title, const std::string& author, const std::string& ISBN) {
+        ExclusiveLock guard(shards);
+        library.addBook(title, author, ISBN);
+    }
+
+    void removeBook(const std::string& ISBN) {
+        ExclusiveLock guard(shards);
+        library.removeBook(ISBN);
+    }
+
+    void removeBooks(const std::vector<std::string>& ISBNs) {
+        ExclusiveLock guard(shards);
+        library.removeBooks(ISBNs);
+    }
+
+    bool registerUser(const std::string& name, const std::string& userID) {
+        ExclusiveLock guard(shards);
+        return library.registerUser(name, userID);
+    }
+
+    // Runs body(library) with every shard held, e.g. for snapshots and full reports
+    template <typename Body>
+    void exclusive(Body body) {
+        ExclusiveLock guard(shards);
+        body(library);
+    }
+};
+
+/*
+ * BranchNetwork Class
+ * Several branches, each a Library of its own with its own catalog,
+ * patrons, snapshot and operation log. A book or patron belongs to the
+ * branch it was added to, and callers address it by branch ID, so no
+ * branch's indexes grow with the others. Each branch has a LibraryService
+ * in front of it; the one call that spans branches, locate(), queries
+ * them in parallel through their services and merges the answers
+ */
+class BranchNetwork {
+public:
+    // One branch's answer to a locate() query
+    struct Holding {
+        size_t branch;
+        size_t copies;
+        size_t available;
+        size_t waiting;  // Patrons in the branch's hold queue for the title
+    };
+
+private:
+    struct Branch {
+        std::unique_ptr<Library> library;
+        std::unique_ptr<LibraryService> service;
+    };
+
+    std::vector<Branch> branches;
+
+public:
+    static const size_t NoBranch = static_cast<size_t>(-1);
+
+    BranchNetwork() = default;
+    BranchNetwork(const BranchNetwork&) = delete;
+    BranchNetwork& operator=(const BranchNetwork&) = delete;
+
+    // Opens a new, empty branch run by librarian; returns its branch ID
+    size_t addBranch(const Librarian& librarian) {
+        Branch branch;
+        branch.library.reset(new Library(librarian));
+        branch.service.reset(new LibraryService(*branch.library));
+        branches.push_back(std::move(branch));
+        return branches.size() - 1;
+    }
+
+    size_t size() const { return branches.size(); }
+    Library& getLibrary(size_t branch) { return *branches[branch].library; }
+    LibraryService& getService(size_t branch) { return *branches[branch].service; }
+
+    // Hands pending log records of every branch to the OS
+    void flushLogs() {
+        for (Branch& branch : branches) {
+            branch.library->flushLog();
+        }
+    }
+
+    // Which branches hold ISBN, with their copy and shelf counts, in branch order.
+    // Branches are split over up to one thread per core (the caller takes the
+    // first share), each querying through the branch's service, so the lookup
+    // can run alongside circulation at every branch
+    std::vector<Holding> locate(const std::string& ISBN) {
+        std::vector<Holding> found(branches.size(), Holding{NoBranch, 0, 0, 0});
+        size_t workers = std::min<size_t>(branches.size(), std::max(1u, std::thread::hardware_concurrency()));
+        auto query = [&](size_t first) {
+            for (size_t i = first; i < branches.size(); i += workers) {
+                Holding& holding = found[i];
+                if (branches[i].service->lookupTitle(ISBN, holding.copies, holding.available, holding.waiting)) {
+                    holding.branch = i;
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t worker = 1; worker < workers; ++worker) {
+            threads.emplace_back(query, worker);
+        }
+        query(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        found.erase(std::remove_if(found.begin(), found.end(), [](const Holding& holding) {
+            return holding.branch == NoBranch;
+        }), found.end());
+        return found;
+    }
+};
+
+/*
+ * Catalog Import
+ * Streams a CSV or TSV file of title, author, ISBN rows into BookRecords.
+ * The delimiter is a tab if the first data line contains one, otherwise a
+ * comma; CSV fields may be double-quoted with "" as an escaped quote.
+ * Blank lines, lines starting with '#' and a leading "title" header row
+ * are ignored
+ */
+bool splitCatalogLine(const std::string& line, char delimiter, std::vector<std::string>& fields) {
+    fields.clear();
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                field += '"';
+                ++i;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                field += c;
+            }
+        } else if (c == '"' && field.empty() && delimiter == ',') {
+            quoted = true;
+        } else if (c == delimiter) {
+            fields.push_back(field);
+            field.clear();
+        } else if (c != '\r') {
+            field += c;
+        }
+    }
+    fields.push_back(field);
+    return !quoted && fields.size() == 3;
+}
+
+// Reads path into records; returns false if the file cannot be opened
+bool readCatalog(const std::string& path, std::vector<BookRecord>& records, size_t& malformed) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    std::string line;
+    std::vector<std::string> fields;
+    char delimiter = 0;
+    bool first = true;
+    malformed = 0;
+    while (std::getline(in, line)) {
+        if (line.empty() || line == "\r" || line[0] == '#') {
+            continue;
+        }
+        if (delimiter == 0) {
+            delimiter = line.find('\t') != std::string::npos ? '\t' : ',';
+        }
+        if (!splitCatalogLine(line, delimiter, fields)) {
+            ++malformed;
+            continue;
+        }
+        if (first) {
+            first = false;
+            std::string head = fields[0];
+            std::transform(head.begin(), head.end(), head.begin(), ::tolower);
+            if (head == "title") {
+                continue;
+            }
+        }
+        records.push_back(BookRecord{std::move(fields[0]), std::move(fields[1]), std::move(fields[2])});
+    }
+    return true;
+}
+
+/*
+ * CatalogValidator Class
+ * Import stage run ahead of Librarian::addBooks. It checks every record's
+ * ISBN checksum, normalizes title and author (trimmed, control characters
+ * dropped, whitespace runs collapsed to one space) and drops records whose
+ * ISBN is invalid, whose title is empty, whose ISBN an earlier record
+ * already used, or that the inventory already holds. The records are split
+ * over one thread per core: each thread checks and normalizes its share,
+ * looks the keys up in the inventory (read-only) and sorts its (key,
+ * position) pairs; the sorted runs are then merged pairwise in parallel,
+ * and one linear pass keeps the first record of each key. Surviving
+ * records keep their file order
+ */
+class CatalogValidator {
+public:
+    struct Result {
+        size_t invalid = 0;     // Bad ISBN or empty title
+        size_t duplicates = 0;  // ISBN repeated within the batch
+        size_t held = 0;        // ISBN already in the inventory
+        unsigned threads = 0;
+    };
+
+private:
+    // Below this many records per thread, more threads cost more than they save
+    static const size_t MinPerThread = 4096;
+
+    enum Verdict : uint8_t { Keep, Invalid, Duplicate, Held };
+
+    // Runs body(first, last) over count items split into threads contiguous ranges
+    template <typename Body>
+    static void parallelRanges(size_t count, unsigned threads, Body body) {
+        size_t share = (count + threads - 1) / threads;
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads && t * share < count; ++t) {
+            workers.emplace_back(body, t * share, std::min(count, (t + 1) * share));
+        }
+        body(size_t(0), std::min(count, share));
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+public:
+    // Trims text, drops control characters and collapses whitespace runs to one space
+    static void normalize(std::string& text) {
+        size_t out = 0;
+        bool space = false;
+        for (char c : text) {
+            unsigned char byte = static_cast<unsigned char>(c);
+            if (byte == ' ' || byte == '\t' || byte == '\n' || byte == '\r' || byte == '\v' || byte == '\f') {
+                space = out > 0;
+            } else if (byte >= 0x20 && byte != 0x7F) {
+                if (space) {
+                    text[out++] = ' ';
+                    space = false;
+                }
+                text[out++] = c;
+            }
+        }
+        text.resize(out);
+    }
+
+    // Filters and normalizes records in place; threads = 0 uses one per core
+    static Result validate(std::vector<BookRecord>& records, const Inventory& inventory, unsigned threads = 0) {
+        Result result;
+        size_t count = records.size();
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, count / MinPerThread)));
+        result.threads = threads;
+
+        std::vector<uint8_t> verdicts(count, Keep);
+        std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+        std::vector<size_t> runs;  // Start of each sorted run, then count
+        size_t share = (count + threads - 1) / threads;
+        for (size_t start = 0; start < count; start += share) {
+            runs.push_back(start);
+        }
+        runs.push_back(count);
+
+        parallelRanges(count, threads, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                BookRecord& record = records[i];
+                normalize(record.title);
+                normalize(record.author);
+                uint64_t key = Isbn::parse(record.ISBN);
+                if (key == Isbn::Invalid || record.title.empty()) {
+                    verdicts[i] = Invalid;
+                    key = Isbn::Invalid;
+                } else if (inventory.contains(key)) {
+                    verdicts[i] = Held;
+                    key = Isbn::Invalid;
+                }
+                keys[i] = std::make_pair(key, static_cast<uint32_t>(i));
+            }
+            std::sort(keys.begin() + first, keys.begin() + last);
+        });
+
+        // Pairwise merges of neighbouring runs, each round's merges in parallel
+        while (runs.size() > 2) {
+            size_t merges = (runs.size() - 1) / 2;
+            std::vector<std::thread> workers;
+            auto merge = [&](size_t m) {
+                std::inplace_merge(keys.begin() + runs[2 * m], keys.begin() + runs[2 * m + 1],
+                                   keys.begin() + runs[std::min(2 * m + 2, runs.size() - 1)]);
+            };
+            for (size_t m = 1; m < merges; ++m) {
+                workers.emplace_back(merge, m);
+            }
+            merge(0);
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+            std::vector<size_t> next;
+            for (size_t r = 0; r + 1 < runs.size(); r += 2) {
+                next.push_back(runs[r]);
+            }
+            next.push_back(count);
+            runs.swap(next);
+        }
+
+        // Equal keys are adjacent, earliest position first
+        for (size_t i = 1; i < count; ++i) {
+            if (keys[i].first != Isbn::Invalid && keys[i].first == keys[i - 1].first) {
+                verdicts[keys[i].second] = Duplicate;
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+            switch (verdicts[i]) {
+                case Keep:
+                    if (kept != i) {
+                        records[kept] = std::move(records[i]);
+                    }
+                    ++kept;
+                    break;
+                case Invalid: ++result.invalid; break;
+                case Duplicate: ++result.duplicates; break;
+                case Held: ++result.held; break;
+            }
+        }
+        records.resize(kept);
+        return result;
+    }
+};
+
+// Loads a catalog file into the library: CatalogValidator, then Librarian::addBooks
+bool importCatalog(Library& library, const std::string& path) {
+    std::vector<BookRecord> records;
+    size_t malformed = 0;
+    if (!readCatalog(path, records, malformed)) {
+        std::cout << "Cannot open catalog file: " << path << "\n";
+        return false;
+    }
+    if (malformed > 0) {
+        std::cout << malformed << " malformed lines in " << path << " ignored.\n";
+    }
+    size_t total = records.size();
+    auto started = std::chrono::steady_clock::now();
+    CatalogValidator::Result result = CatalogValidator::validate(records, library.getInventory());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "Validated " << total << " records in " << seconds * 1000.0 << " ms on " << result.threads
+              << " threads: " << result.invalid << " invalid, " << result.duplicates << " duplicate ISBNs, "
+              << result.held << " already held.\n";
+    library.addBooks(records);
+    return true;
+}
+
+/*
+ * TraceRecorder Class
+ * Appends the commands of a live session to a trace file in the
+ * CommandDriver format, so the session can be replayed with --batch or
+ * timed with --replay. Batch and TCP commands are recorded as received;
+ * menu actions are written as the command that does the same thing
+ */
+class TraceRecorder {
+private:
+    std::ofstream out;
+
+public:
+    bool open(const std::string& path) {
+        out.open(path, std::ios::app);
+        if (!out) {
+            std::cout << "Cannot open trace file: " << path << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool isOpen() const { return out.is_open(); }
+
+    void record(std::string_view line) {
+        if (out.is_open()) {
+            out.write(line.data(), static_cast<std::streamsize>(line.size()));
+            out.put('\n');
+        }
+    }
+
+    void flush() { out.flush(); }
+};
+
+/*
+ * WorkloadGenerator Class
+ * Writes a synthetic trace in the CommandDriver format: the titles (one
+ * copy each) and patrons first, then a mix of BORROW, RETURN and PAY.
+ * Borrowed titles follow a Zipf distribution with exponent skew, so a few
+ * titles are in constant demand. The generator tracks loans and hold
+ * queues the way the library does, so returns name books their patron
+ * actually holds and popular titles build up waiting lists. Payments are
+ * $0.01 to $20.00; a replay accrues few fines (loans fall due after it
+ * ends), so most are turned away as exceeding what the patron owes, after
+ * the same lookup and checks a real payment takes. The same spec and seed
+ * always give the same trace
+ */
+class WorkloadGenerator {
+public:
+    struct Spec {
+        size_t titles = 1000;
+        size_t patrons = 100;
+        double skew = 1.0;     // Zipf exponent; 0 is uniform
+        unsigned borrow = 60;  // Operation mix, as relative weights
+        unsigned giveBack = 35;
+        unsigned pay = 5;
+        uint64_t seed = 1;
+    };
+
+private:
+    // Rank r (0-based) is drawn with probability proportional to 1 / (r + 1)^skew
+    class ZipfSampler {
+    private:
+        std::vector<double> cumulative;
+
+    public:
+        ZipfSampler(size_t count, double skew) : cumulative(count) {
+            double total = 0;
+            for (size_t r = 0; r < count; ++r) {
+                total += 1.0 / std::pow(static_cast<double>(r + 1), skew);
+                cumulative[r] = total;
+            }
+        }
+
+        size_t operator()(std::mt19937_64& random) const {
+            double target = std::uniform_real_distribution<double>(0.0, cumulative.back())(random);
+            size_t rank = static_cast<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), target) -
+                                              cumulative.begin());
+            return std::min(rank, cumulative.size() - 1);
+        }
+    };
+
+public:
+    static std::string isbnFor(size_t title) { return std::to_string(Isbn::fromPrefix(978100000000ULL + title)); }
+
+    // Writes the setup and ops operations to out; returns the number of lines written
+    static size_t write(std::ostream& out, const Spec& spec, size_t ops) {
+        std::mt19937_64 random(spec.seed);
+        ZipfSampler popularity(spec.titles, spec.skew);
+        std::uniform_int_distribution<size_t> anyPatron(0, spec.patrons - 1);
+        std::uniform_int_distribution<unsigned> anyOp(0, spec.borrow + spec.giveBack + spec.pay - 1);
+        std::uniform_int_distribution<int64_t> anyPayment(1, 2000);  // Cents
+
+        // Titles are shuffled so popularity does not follow ISBN order
+        std::vector<size_t> titleOf(spec.titles);
+        for (size_t i = 0; i < spec.titles; ++i) {
+            titleOf[i] = i;
+        }
+        std::shuffle(titleOf.begin(), titleOf.end(), random);
+
+        std::string line;
+        for (size_t i = 0; i < spec.titles; ++i) {
+            line.assign("ADD ").append(isbnFor(i)).append(" Title ").append(std::to_string(i))
+                .append("|Author ").append(std::to_string(i % 997)).append("\n");
+            out << line;
+        }
+        for (size_t i = 0; i < spec.patrons; ++i) {
+            out << "REGISTER P" << i << " Patron " << i << "\n";
+        }
+
+        const size_t NoPatron = static_cast<size_t>(-1);
+        std::vector<size_t> holder(spec.titles, NoPatron);
+        std::vector<std::deque<size_t>> waiting(spec.titles);
+        std::vector<size_t> loans;  // Titles currently out, in no particular order
+        for (size_t op = 0; op < ops; ++op) {
+            unsigned pick = anyOp(random);
+            if (pick >= spec.borrow + spec.giveBack) {
+                size_t patron = anyPatron(random);
+                out << "PAY P" << patron << " " << formatCents(anyPayment(random)) << "\n";
+                continue;
+            }
+            if (pick >= spec.borrow && !loans.empty()) {
+                size_t at = std::uniform_int_distribution<size_t>(0, loans.size() - 1)(random);
+                size_t title = loans[at];
+                out << "RETURN P" << holder[title] << " " << isbnFor(title) << "\n";
+                if (waiting[title].empty()) {
+                    holder[title] = NoPatron;
+                    loans[at] = loans.back();
+                    loans.pop_back();
+                } else {
+                    holder[title] = waiting[title].front();  // The library hands it to the next in line
+                    waiting[title].pop_front();
+                }
+                continue;
+            }
+
+            // Borrow, or join the queue. A patron never asks for a book already in hand or
+            // waited for; after a few such draws the patron pays instead
+            size_t patron = 0, title = 0;
+            bool drawn = false;
+            for (int attempt = 0; attempt < 8 && !drawn; ++attempt) {
+                patron = anyPatron(random);
+                title = titleOf[popularity(random)];
+                drawn = holder[title] != patron &&
+                        std::find(waiting[title].begin(), waiting[title].end(), patron) == waiting[title].end();
+            }
+            if (!drawn) {
+                out << "PAY P" << patron << " " << formatCents(anyPayment(random)) << "\n";
+            } else if (holder[title] == NoPatron) {
+                out << "BORROW P" << patron << " " << isbnFor(title) << "\n";
+                holder[title] = patron;
+                loans.push_back(title);
+            } else {
+                out << "BORROW P" << patron << " " << isbnFor(title) << "\n";
+                waiting[title].push_back(patron);
+            }
+        }
+        return spec.titles + spec.patrons + ops;
+    }
+};
+
+/*
+ * CommandDriver Class
+ * Headless front end: executes compact one-line commands from a file or
+ * stdin without printing menus or index lists. Commands (case-sensitive
+ * keywords, whitespace-separated arguments, blank lines and '#' comments
+ * ignored):
+ *   ADD <ISBN> <title>|<author>
+ *   REMOVE <ISBN>
+ *   WEED <ISBN>...   (removes every shelved copy of each ISBN in one pass)
+ *   LIST [all|available|out] [offset] [limit]
+ *   REGISTER <userID> <name>
+ *   BORROW <userID> <ISBN>  (places a hold if every copy is out)
+ *   RETURN <userID> <ISBN>
+ *   CHECKOUT <userID> <ISBN>...   (borrows the whole stack or nothing)
+ *   CHECKIN <userID> <ISBN>...    (returns the whole stack or nothing)
+ *   PAY <userID> <amount>
+ *   CLASS <userID> <patron class>   (selects the user's loan policy)
+ *   INFO <userID>
+ *   OVERDUE
+ *   ACCRUE
+ *   SEARCH <terms>   (a term ending in '*' is a prefix)
+ *   USERS            (every user with fines and loans)
+ *   STATS            (book, loan and fine totals)
+ *   METRICS          (Prometheus text; needs -DLMS_METRICS)
+ *   BRANCH <branch ID>   (addresses the following commands to that branch)
+ *   LOCATE <ISBN>        (holdings of the title at every branch)
+ * Each command prints the same messages as the matching menu option
+ */
+class CommandDriver {
+private:
+    BranchNetwork* network = nullptr;  // Set when commands may switch branches
+    Library* library;                  // The branch commands currently address
+    size_t branch = 0;
+    TraceRecorder* recorder = nullptr;
+    size_t patron = UserDirectory::NotFound;  // The user the current command named
+
+    // Splits the next whitespace-delimited token off the front of line
+    static std::string nextToken(const std::string& line, size_t& pos) {
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) {
+            ++pos;
+        }
+        size_t start = pos;
+        while (pos < line.size() && line[pos] != ' ' && line[pos] != '\t' && line[pos] != '\r') {
+            ++pos;
+        }
+        return line.substr(start, pos - start);
+    }
+
+    // Everything after pos with surrounding whitespace trimmed
+    static std::string rest(const std::string& line, size_t pos) {
+        size_t start = line.find_first_not_of(" \t", pos);
+        if (start == std::string::npos) {
+            return "";
+        }
+        size_t end = line.find_last_not_of(" \t\r");
+        return line.substr(start, end - start + 1);
+    }
+
+    User* findUser(const std::string& userID, size_t& index) {
+        index = library->findUser(userID);
+        if (index == UserDirectory::NotFound) {
+            std::cout << "User not found: " << userID << "\n";
+            return nullptr;
+        }
+        patron = index;
+        return &library->getUsers()[index];
+    }
+
+    Book* findBook(const std::string& ISBN) {
+        Book* book = library->getInventory().find(ISBN);
+        if (book == nullptr) {
+            std::cout << "Book not found in inventory.\n";
+        }
+        return book;
+    }
 
 public:
-    // Constructor initializes book details and sets default availability
-    Book(std::string title, std::string author, std::string ISBN)
-        : title(title), author(author), ISBN(ISBN), isAvailable(true), dueDate(0) {}
+    explicit CommandDriver(Library& library) : library(&library) {}
 
-    // Getter methods
-    std::string getTitle() const { return title; }
-    std::string getAuthor() const { return author; }
-    std::string getISBN() const { return ISBN; }
-    bool getAvailability() const { return isAvailable; }
-    time_t getDueDate() const { return dueDate; }
+    // Starts at branch 0; BRANCH switches branches and LOCATE searches all of them
+    explicit CommandDriver(BranchNetwork& network) : network(&network), library(&network.getLibrary(0)) {}
 
-    // Setter methods
-    void setAvailability(bool available) { isAvailable = available; }
-    void setDueDate(time_t date) { dueDate = date; }
+    // Records every command line executed from now on, or stops recording with nullptr
+    void setRecorder(TraceRecorder* next) { recorder = next; }
 
-    // Displays book information
-    void displayInfo() const {
-        std::cout << "Title: " << title << "\nAuthor: " << author
-                  << "\nISBN: " << ISBN << "\nStatus: "
-                  << (isAvailable ? "Available" : "Checked Out") << "\n";
+    // The branch addressed by catalog and circulation commands
+    size_t getBranch() const { return branch; }
+    void selectBranch(size_t next) {
+        branch = next;
+        library = network != nullptr ? &network->getLibrary(next) : library;
+    }
+
+    // Executes one command line, then tells the user it named about holds filled for
+    // them since; returns false if the line was malformed
+    bool execute(const std::string& line) {
+        patron = UserDirectory::NotFound;
+        bool ok = dispatch(line);
+        if (patron != UserDirectory::NotFound) {
+            library->announceHolds(patron);
+        }
+        return ok;
+    }
+
+    bool dispatch(const std::string& line) {
+        size_t pos = 0;
+        std::string command = nextToken(line, pos);
+        if (command.empty() || command[0] == '#') {
+            return true;
+        }
+        if (recorder != nullptr) {
+            recorder->record(rest(line, 0));
+        }
+
+        if (command == "BORROW" || command == "RETURN") {
+            std::string userID = nextToken(line, pos);
+            std::string ISBN = nextToken(line, pos);
+            if (ISBN.empty()) {
+                std::cout << "Usage: " << command << " <userID> <ISBN>\n";
+                return false;
+            }
+            size_t index;
+            User* user = findUser(userID, index);
+            Book* book = nullptr;
+            if (user != nullptr && command == "RETURN") {
+                // The copy to return is the one this user holds, not whichever is on the shelf
+                book = user->loanOf(library->getInventory(), Isbn::parse(ISBN));
+            }
+            if (user != nullptr && (book != nullptr || (book = findBook(ISBN)) != nullptr)) {
+                if (command == "BORROW") {
+                    library->borrowBook(index, book);
+                } else {
+                    library->returnBook(index, book);
+                }
+            }
+        } else if (command == "CHECKOUT" || command == "CHECKIN") {
+            std::string userID = nextToken(line, pos);
+            std::vector<std::string> ISBNs;
+            for (std::string ISBN = nextToken(line, pos); !ISBN.empty(); ISBN = nextToken(line, pos)) {
+                ISBNs.push_back(ISBN);
+            }
+            if (ISBNs.empty()) {
+                std::cout << "Usage: " << command << " <userID> <ISBN>...\n";
+                return false;
+            }
+            size_t index;
+            if (findUser(userID, index)) {
+                if (command == "CHECKOUT") {
+                    library->borrowBooks(index, ISBNs);
+                } else {
+                    library->returnBooks(index, ISBNs);
+                }
+            }
+        } else if (command == "PAY") {
+            std::string userID = nextToken(line, pos);
+            std::string amount = nextToken(line, pos);
+            char* end = nullptr;
+            double value = std::strtod(amount.c_str(), &end);
+            if (amount.empty() || *end != '\0') {
+                std::cout << "Usage: PAY <userID> <amount>\n";
+                return false;
+            }
+            size_t index;
+            if (findUser(userID, index)) {
+                library->payFines(index, value);
+            }
+        } else if (command == "CLASS") {
+            std::string userID = nextToken(line, pos);
+            std::string patronClass = nextToken(line, pos);
+            char* end = nullptr;
+            unsigned long value = std::strtoul(patronClass.c_str(), &end, 10);
+            if (patronClass.empty() || *end != '\0') {
+                std::cout << "Usage: CLASS <userID> <patron class>\n";
+                return false;
+            }
+            size_t index;
+            if (!findUser(userID, index)) {
+                return false;
+            }
+            if (value >= LoanPolicyTable::MaxClasses ||
+                !library->setPatronClass(index, static_cast<uint32_t>(value))) {
+                std::cout << "Patron classes are 0-" << LoanPolicyTable::MaxClasses - 1 << ".\n";
+                return false;
+            }
+            const LoanPolicy& policy = library->getLoanPolicy(static_cast<uint32_t>(value));
+            std::cout << "Patron class set to " << value << ": " << policy.loanSeconds << " second loans, $"
+                      << formatCents(policy.centsPerPeriod) << " per " << policy.periodSeconds
+                      << " seconds late after " << policy.graceSeconds << " seconds of grace";
+            if (policy.capCents > 0) {
+                std::cout << ", at most $" << formatCents(policy.capCents) << " per loan";
+            }
+            std::cout << ".\n";
+        } else if (command == "ADD") {
+            std::string ISBN = nextToken(line, pos);
+            std::string text = rest(line, pos);
+            size_t bar = text.find('|');
+            if (ISBN.empty() || bar == std::string::npos) {
+                std::cout << "Usage: ADD <ISBN> <title>|<author>\n";
+                return false;
+            }
+            library->addBook(rest(text.substr(0, bar), 0), rest(text, bar + 1), ISBN);
+        } else if (command == "REMOVE") {
+            std::string ISBN = nextToken(line, pos);
+            if (ISBN.empty()) {
+                std::cout << "Usage: REMOVE <ISBN>\n";
+                return false;
+            }
+            library->removeBook(ISBN);
+        } else if (command == "WEED") {
+            std::vector<std::string> ISBNs;
+            for (std::string ISBN = nextToken(line, pos); !ISBN.empty(); ISBN = nextToken(line, pos)) {
+                ISBNs.push_back(ISBN);
+            }
+            if (ISBNs.empty()) {
+                std::cout << "Usage: WEED <ISBN>...\n";
+                return false;
+            }
+            library->removeBooks(ISBNs);
+        } else if (command == "BRANCH") {
+            std::string id = nextToken(line, pos);
+            char* end = nullptr;
+            unsigned long value = std::strtoul(id.c_str(), &end, 10);
+            size_t count = network != nullptr ? network->size() : 1;
+            if (id.empty() || *end != '\0' || value >= count) {
+                std::cout << "Usage: BRANCH <0-" << count - 1 << ">\n";
+                return false;
+            }
+            selectBranch(value);
+            std::cout << "Branch " << value << " selected.\n";
+        } else if (command == "LOCATE") {
+            std::string ISBN = nextToken(line, pos);
+            if (ISBN.empty()) {
+                std::cout << "Usage: LOCATE <ISBN>\n";
+                return false;
+            }
+            if (network == nullptr) {
+                std::cout << "Only one branch is open.\n";
+                return false;
+            }
+            std::vector<BranchNetwork::Holding> holdings = network->locate(ISBN);
+            size_t available = 0;
+            for (const BranchNetwork::Holding& holding : holdings) {
+                std::cout << "Branch " << holding.branch << ": " << holding.available << " of "
+                          << holding.copies << " available";
+                if (holding.waiting > 0) {
+                    std::cout << ", " << holding.waiting << " waiting";
+                }
+                std::cout << "\n";
+                available += holding.available;
+            }
+            std::cout << "Held at " << holdings.size() << " of " << network->size() << " branches, "
+                      << available << " copies available.\n";
+        } else if (command == "REGISTER") {
+            std::string userID = nextToken(line, pos);
+            std::string name = rest(line, pos);
+            if (name.empty()) {
+                std::cout << "Usage: REGISTER <userID> <name>\n";
+                return false;
+            }
+            if (!library->registerUser(name, userID)) {
+                return false;
+            }
+        } else if (command == "INFO") {
+            size_t index;
+            if (User* user = findUser(nextToken(line, pos), index)) {
+                library->getLibrarian().displayUserInfo(*user, library->getInventory());
+            }
+        } else if (command == "OVERDUE") {
+            library->reportOverdue(time(0));
+        } else if (command == "SEARCH") {
+            std::string query = rest(line, pos);
+            if (query.empty()) {
+                std::cout << "Usage: SEARCH <terms>\n";
+                return false;
+            }
+            std::vector<Title*> matches;
+            library->getLibrarian().searchCatalog(library->getInventory(), query, matches);
+        } else if (command == "ACCRUE") {
+            library->accrueFines(time(0));
+        } else if (command == "USERS") {
+            library->getLibrarian().displayUsers(*library->captureView());
+        } else if (command == "STATS") {
+            library->displayStats(time(0));
+        } else if (command == "METRICS") {
+#ifdef LMS_METRICS
+            Metrics::writePrometheus(std::cout);
+#else
+            std::cout << "Metrics are not compiled in (build with -DLMS_METRICS).\n";
+#endif
+        } else if (command == "LIST") {
+            InventoryPage page;
+            std::string token = nextToken(line, pos);
+            if (token == "available" || token == "out" || token == "all") {
+                page.filter = token == "available" ? InventoryPage::Filter::Available
+                            : token == "out"       ? InventoryPage::Filter::CheckedOut
+                                                   : InventoryPage::Filter::All;
+                token = nextToken(line, pos);
+            }
+            std::string limit = nextToken(line, pos);
+            char* end = nullptr;
+            bool valid = true;
+            if (!token.empty()) {
+                page.offset = std::strtoull(token.c_str(), &end, 10);
+                valid = *end == '\0';
+            }
+            if (valid && !limit.empty()) {
+                page.limit = std::strtoull(limit.c_str(), &end, 10);
+                valid = *end == '\0';
+            }
+            if (!valid) {
+                std::cout << "Usage: LIST [all|available|out] [offset] [limit]\n";
+                return false;
+            }
+            library->getLibrarian().displayInventory(library->getInventory(), page);
+        } else {
+            std::cout << "Unknown command: " << command << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Runs every command in in; the summary goes to stderr so stdout holds only command output
+    size_t run(std::istream& in) {
+        auto started = std::chrono::steady_clock::now();
+        size_t executed = 0, failed = 0;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!execute(line)) {
+                ++failed;
+            }
+            ++executed;
+        }
+        std::cout.flush();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cerr << "Processed " << executed << " commands (" << failed << " rejected) in "
+                  << seconds * 1000.0 << " ms, "
+                  << static_cast<uint64_t>(seconds > 0 ? executed / seconds : 0) << " ops/sec.\n";
+        return executed;
     }
 };
 
+#ifdef __linux__
 /*
- * User Class
- * Represents a library patron who can borrow books
+ * RequestServer Class (Linux)
+ * TCP front end speaking the CommandDriver protocol: clients send command
+ * lines and get back, per command, whatever it printed followed by a
+ * status line "OK" or "ERR" ("QUIT" closes the connection). One thread
+ * runs an edge-triggered epoll loop over non-blocking sockets, so an idle
+ * desk or kiosk costs only its buffers. That thread also executes every
+ * command, straight on the Library in arrival order: the server serialises
+ * all clients and does not go through LibraryService, so it gains nothing
+ * from the sharded locks and a slow command stalls every connection until
+ * it finishes. Each connection starts at branch 0 and keeps its own
+ * BRANCH selection. Output is captured by pointing std::cout at the
+ * connection's output buffer while its commands run; a client that stops
+ * reading is not served further until it catches up
  */
-class User {
+class RequestServer {
 private:
-    std::string name;
-    std::string userID;
-    std::vector<Book*> borrowedBooks;  // Tracks books currently borrowed
-    double fines;                      // Accumulated fines
+    static const size_t ReadChunk = 16 * 1024;
+    static const size_t MaxLine = 64 * 1024;    // A longer line closes the connection
+    static const size_t MaxPending = 1 << 20;   // Unsent output above this pauses the client's commands
 
-public:
-    // Constructor initializes user details with no fines
-    User(std::string name, std::string userID)
-        : name(name), userID(userID), fines(0.0) {}
+    struct Connection {
+        int fd;
+        std::string input;
+        std::string output;
+        size_t sent = 0;
+        bool readable = true;   // Not yet read to EAGAIN since the last edge
+        bool eof = false;       // The client has finished sending
+        bool quit = false;      // The client sent QUIT; nothing after it runs
+        size_t branch = 0;      // The client's BRANCH selection
+    };
 
-    // Getter methods
-    std::string getName() const { return name; }
-    std::string getUserID() const { return userID; }
-    double getFines() const { return fines; }
-    const std::vector<Book*>& getBorrowedBooks() const { return borrowedBooks; }
+    // Appends everything written through it to the current target string
+    class StringSink : public std::streambuf {
+    private:
+        std::string* target = nullptr;
 
-    // Allows user to borrow a book
-    void borrowBook(Book* book) {
-        if (book->getAvailability()) {  // it checks if the book is available
-            borrowedBooks.push_back(book);
-            book->setAvailability(false);
-
-            // Set due date to 5 seconds from now
-            time_t now = time(0);
-            book->setDueDate(now + 5); // 5  seconds
-            std::cout << "Book borrowed successfully.\n";
-        } else {
-            std::cout << "Book is not available.\n";
+    protected:
+        int_type overflow(int_type c) override {
+            if (c != traits_type::eof()) {
+                target->push_back(static_cast<char>(c));
+            }
+            return c;
+        }
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            target->append(data, static_cast<size_t>(size));
+            return size;
         }
+
+    public:
+        void setTarget(std::string* next) { target = next; }
+    };
+
+    BranchNetwork& network;
+    CommandDriver driver;
+    StringSink sink;
+    int listener = -1;
+    int poller = -1;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+
+    static volatile std::sig_atomic_t& stopRequested() {
+        static volatile std::sig_atomic_t flag = 0;
+        return flag;
     }
+    static void requestStop(int) { stopRequested() = 1; }
 
-    // Allows user to return a book
-    void returnBook(Book* book) {
-        auto it = std::find(borrowedBooks.begin(), borrowedBooks.end(), book);
-        if (it != borrowedBooks.end()) {
-            borrowedBooks.erase(it);
-            book->setAvailability(true);
-
-            // Calculate fine if overdue
-            time_t now = time(0);
-            if (now > book->getDueDate()) {
-                double daysOverdue = difftime(now, book->getDueDate()) / (1);
-                fines += daysOverdue * 2; // $2 dollars per second
-                std::cout << "Book returned late. Fine added: $" << daysOverdue * 2 << "\n";
-            }
-
-            book->setDueDate(0);
-            std::cout << "Book returned successfully.\n";
-        } else {
-            std::cout << "You didn't borrow this book.\n";
+    void close(Connection* connection) {
+        ::epoll_ctl(poller, EPOLL_CTL_DEL, connection->fd, nullptr);
+        ::close(connection->fd);
+        connections.erase(connection->fd);
+    }
+
+    void acceptAll() {
+        for (;;) {
+            int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;  // EAGAIN, or out of descriptors until a client leaves
+            }
+            int on = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            std::unique_ptr<Connection> connection(new Connection);
+            connection->fd = fd;
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = connection.get();
+            if (::epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event) != 0) {
+                ::close(fd);
+                continue;
+            }
+            connections.emplace(fd, std::move(connection));
         }
     }
 
-    // Allows user to pay fines
-    void payFines(double amount) {
-        if (amount <= fines) {
-            fines -= amount;
-            std::cout << "Paid $" << amount << " towards fines. Remaining: $" << fines << "\n";
-        } else {
-            std::cout << "Payment exceeds owed fines.\n";
+    // Reads what the socket holds; false on error or an overlong line
+    bool readAll(Connection& connection) {
+        char buffer[ReadChunk];
+        while (connection.readable && !connection.eof) {
+            ssize_t received = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                connection.input.append(buffer, static_cast<size_t>(received));
+                if (connection.input.size() > MaxLine && connection.input.find('\n') == std::string::npos) {
+                    return false;
+                }
+                if (connection.input.size() > MaxPending) {
+                    return true;  // Enough queued; the rest waits for the commands to drain
+                }
+            } else if (received == 0) {
+                connection.eof = true;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                connection.readable = false;
+            } else if (errno != EINTR) {
+                return false;
+            }
         }
+        return true;
     }
 
-    // Displays user information
-    void displayInfo() const {
-        std::cout << "User: " << name << "\nID: " << userID
-                  << "\nFines: $" << fines << "\nBorrowed books: "
-                  << borrowedBooks.size() << "\n";
+    // Runs the complete lines in the input until the output backs up
+    void execute(Connection& connection) {
+        size_t start = 0, end;
+        std::streambuf* console = std::cout.rdbuf(&sink);
+        sink.setTarget(&connection.output);
+        driver.selectBranch(connection.branch);
+        while (!connection.quit && connection.output.size() - connection.sent < MaxPending &&
+               (end = connection.input.find('\n', start)) != std::string::npos) {
+            std::string line = connection.input.substr(start, end - start);
+            start = end + 1;
+            if (line == "QUIT" || line == "QUIT\r") {
+                connection.quit = true;
+            } else {
+                connection.output += driver.execute(line) ? "OK\n" : "ERR\n";
+            }
+        }
+        std::cout.rdbuf(console);
+        connection.branch = driver.getBranch();
+        connection.input.erase(0, start);
+    }
+
+    // Sends pending output; false on error
+    bool writeAll(Connection& connection) {
+        while (connection.sent < connection.output.size()) {
+            ssize_t written = ::send(connection.fd, connection.output.data() + connection.sent,
+                                     connection.output.size() - connection.sent, MSG_NOSIGNAL);
+            if (written > 0) {
+                connection.sent += static_cast<size_t>(written);
+            } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else if (written < 0 && errno == EINTR) {
+                continue;
+            } else {
+                return false;
+            }
+        }
+        if (connection.sent == connection.output.size()) {
+            connection.output.clear();
+            connection.sent = 0;
+        } else if (connection.sent > MaxPending) {
+            connection.output.erase(0, connection.sent);
+            connection.sent = 0;
+        }
+        return true;
+    }
+
+    // Makes as much progress as the socket allows; returns false once the connection is done
+    bool serve(Connection& connection) {
+        for (;;) {
+            if (!readAll(connection)) {
+                return false;
+            }
+            execute(connection);
+            if (!writeAll(connection)) {
+                return false;
+            }
+            bool unsent = !connection.output.empty();  // Only left over when the socket is full
+            bool runnable = !connection.quit && connection.input.find('\n') != std::string::npos;
+            if ((connection.quit || connection.eof) && !unsent && !runnable) {
+                return false;
+            }
+            if (unsent || (!runnable && !connection.readable)) {
+                return true;  // Wait for the next edge
+            }
+        }
+    }
+
+public:
+    explicit RequestServer(BranchNetwork& network) : network(network), driver(network) {}
+
+    // Records every command served (see TraceRecorder)
+    void setRecorder(TraceRecorder* recorder) { driver.setRecorder(recorder); }
+    RequestServer(const RequestServer&) = delete;
+    RequestServer& operator=(const RequestServer&) = delete;
+
+    ~RequestServer() {
+        for (auto& entry : connections) {
+            ::close(entry.first);
+        }
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        if (poller >= 0) {
+            ::close(poller);
+        }
+    }
+
+    // Serves clients on port (0 for any free one) until SIGINT or SIGTERM; returns false if
+    // the port cannot be opened. The port actually bound is announced before the first client
+    bool run(uint16_t port) {
+        // Many desks means many descriptors; take as many as the hard limit allows
+        rlimit files{};
+        if (::getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+            files.rlim_cur = files.rlim_max;
+            ::setrlimit(RLIMIT_NOFILE, &files);
+        }
+
+        listener = ::socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int on = 1, off = 0;
+        sockaddr_in6 address{};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        if (listener < 0 ||
+            ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+            ::setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) != 0 ||
+            ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0) {
+            std::cout << "Cannot listen on port " << port << ": " << std::strerror(errno) << "\n";
+            return false;
+        }
+        socklen_t length = sizeof(address);
+        if (::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) == 0) {
+            port = ntohs(address.sin6_port);
+        }
+        poller = ::epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;  // The listener
+        if (poller < 0 || ::epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event) != 0) {
+            std::cout << "Cannot start the event loop: " << std::strerror(errno) << "\n";
+            return false;
+        }
+
+        struct sigaction stop{};
+        stop.sa_handler = requestStop;  // No SA_RESTART, so epoll_wait returns to check the flag
+        ::sigaction(SIGINT, &stop, nullptr);
+        ::sigaction(SIGTERM, &stop, nullptr);
+        std::cout << "Serving on port " << port << ".\n";
+        std::cout.flush();
+
+        std::vector<epoll_event> events(1024);
+        while (!stopRequested()) {
+            int ready = ::epoll_wait(poller, events.data(), static_cast<int>(events.size()), -1);
+            for (int i = 0; i < ready; ++i) {
+                Connection* connection = static_cast<Connection*>(events[i].data.ptr);
+                if (connection == nullptr) {
+                    acceptAll();
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    connection->readable = true;
+                }
+                if ((events[i].events & EPOLLERR) || !serve(*connection)) {
+                    close(connection);
+                }
+            }
+            network.flushLogs();
+        }
+        std::cout << "Stopped serving; " << connections.size() << " clients disconnected.\n";
+        return true;
     }
 };
+#endif
 
 /*
- * Librarian Class
- * Handles administrative tasks for the library
+ * Benchmark Class
+ * Micro-benchmarks for the core Librarian and User operations, run at
+ * catalog sizes from 1e3 up to a chosen maximum (powers of ten). Reports
+ * ns/op and heap allocations/op (the latter counted only in builds with
+ * -DLMS_COUNT_ALLOCATIONS); everything the operations print is
+ * formatted into a discarding stream so output cost is included but the
+ * terminal is not
  */
-class Librarian {
+class Benchmark {
 private:
-    std::string name;
-    std::string employeeID;
+    // Stream buffer that accepts and drops everything
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return traits_type::not_eof(c); }
+        std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+    };
 
-public:
-    // Constructor
-    Librarian(std::string name, std::string employeeID)
-        : name(name), employeeID(employeeID) {}
+    static void report(size_t size, const char* operation, size_t ops,
+                       std::chrono::steady_clock::duration elapsed, uint64_t allocations) {
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        std::fprintf(stdout, "%-10zu %-18s %12.1f %12.2f\n", size, operation,
+                     ops != 0 ? ns / ops : 0.0, ops != 0 ? double(allocations) / ops : 0.0);
+    }
 
-    // Adds a new book to the inventory
-    void addBook(std::vector<Book>& inventory, const std::string& title,
-                 const std::string& author, const std::string& ISBN) {
-        inventory.emplace_back(title, author, ISBN);
-        std::cout << "Book added to inventory.\n";
+    // Times body(i) for i in [0, ops) and reports it
+    template <typename Body>
+    static void measure(size_t size, const char* operation, size_t ops, Body body) {
+        uint64_t allocationsBefore = allocationCount;
+        auto started = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            body(i);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - started;
+        report(size, operation, ops, elapsed, allocationCount - allocationsBefore);
     }
 
-    // Removes a book from inventory by ISBN
-    void removeBook(std::vector<Book>& inventory, const std::string& ISBN) {
-        auto it = std::find_if(inventory.begin(), inventory.end(),
-            [&ISBN](const Book& b) { return b.getISBN() == ISBN; });
+    // Says once, ahead of a table, when its allocs/op column cannot be filled in
+    static void noteAllocationCounting() {
+#ifndef LMS_COUNT_ALLOCATIONS
+        std::fprintf(stdout, "(allocs/op reads 0: build with -DLMS_COUNT_ALLOCATIONS to count allocations)\n");
+#endif
+    }
 
-        if (it != inventory.end()) {
-            inventory.erase(it);
-            std::cout << "Book removed from inventory.\n";
-        } else {
-            std::cout << "Book not found in inventory.\n";
+    static std::string isbnFor(size_t i) { return std::to_string(Isbn::fromPrefix(978000000000ULL + i)); }
+
+    static void runSize(size_t size, std::mt19937_64& random) {
+        Librarian librarian("Bench", "B001");
+        Inventory inventory;
+        UserDirectory users;
+        size_t userCount = std::min<size_t>(size, 1000);
+        for (size_t i = 0; i < userCount; ++i) {
+            users.add("Patron " + std::to_string(i), "U" + std::to_string(i));
+        }
+        size_t ops = std::min<size_t>(size, 100000);
+
+        std::vector<std::string> isbns(size);
+        for (size_t i = 0; i < size; ++i) {
+            isbns[i] = isbnFor(i);
         }
+        std::string title = "Benchmark Title", author = "Benchmark Author";
+
+        // Import validation of the catalog with every tenth row repeated; figures are per record
+        std::vector<BookRecord> records(size);
+        for (size_t i = 0; i < size; ++i) {
+            records[i] = BookRecord{" Benchmark  Title ", "Benchmark Author", isbns[i % 10 == 9 ? i - 1 : i]};
+        }
+        uint64_t validateAllocations = allocationCount;
+        auto validateStarted = std::chrono::steady_clock::now();
+        CatalogValidator::validate(records, inventory);
+        report(size, "validateCatalog", size, std::chrono::steady_clock::now() - validateStarted,
+               allocationCount - validateAllocations);
+
+        measure(size, "addBook", size, [&](size_t i) {
+            librarian.addBook(inventory, title, author, isbns[i]);
+        });
+
+        // Remove a random sample, then put it back so the catalog size stays fixed
+        std::vector<size_t> sample(ops);
+        for (size_t& index : sample) {
+            index = random() % size;
+        }
+        std::sort(sample.begin(), sample.end());
+        sample.erase(std::unique(sample.begin(), sample.end()), sample.end());
+        measure(size, "removeBook", sample.size(), [&](size_t i) {
+            librarian.removeBook(inventory, isbns[sample[i]]);
+        });
+        for (size_t index : sample) {
+            librarian.addBook(inventory, title, author, isbns[index]);
+        }
+
+        // The same sample weeded in one call; figures are per book removed
+        std::vector<std::string> weeded(sample.size());
+        for (size_t i = 0; i < sample.size(); ++i) {
+            weeded[i] = isbns[sample[i]];
+        }
+        std::vector<BookHandle> removed;
+        uint64_t weedAllocations = allocationCount;
+        auto weedStarted = std::chrono::steady_clock::now();
+        librarian.removeBooks(inventory, weeded, removed);
+        report(size, "removeBooks", removed.size(), std::chrono::steady_clock::now() - weedStarted,
+               allocationCount - weedAllocations);
+        for (size_t index : sample) {
+            librarian.addBook(inventory, title, author, isbns[index]);
+        }
+
+        // Borrow distinct books round-robin across users, then return them
+        std::vector<Book*> books(sample.size());
+        for (size_t i = 0; i < sample.size(); ++i) {
+            books[i] = inventory.find(isbns[sample[i]]);
+        }
+        time_t now = time(0);
+        measure(size, "borrowBook", books.size(), [&](size_t i) {
+            users[i % userCount].borrowBook(books[i], now);
+        });
+
+        // Column scans while the sample is checked out; figures are per book scanned
+        size_t counted = 0;
+        auto scanned = std::chrono::steady_clock::now();
+        counted += inventory.countAvailable();
+        report(size, "countAvailable", inventory.size(), std::chrono::steady_clock::now() - scanned, 0);
+        if (inventory.availableCount() != counted) {
+            std::fprintf(stdout, "available count mismatch: %zu kept, %zu counted\n",
+                         inventory.availableCount(), counted);
+        }
+        scanned = std::chrono::steady_clock::now();
+        counted += inventory.countOverdue(now + 10);
+        report(size, "countOverdue", inventory.size(), std::chrono::steady_clock::now() - scanned, 0);
+        if (counted != inventory.size()) {
+            std::fprintf(stdout, "column scan mismatch: %zu of %zu books\n", counted, inventory.size());
+        }
+
+        measure(size, "returnBook", books.size(), [&](size_t i) {
+            users[i % userCount].returnBook(inventory, books[i], now);
+        });
+        measure(size, "payFines", ops, [&](size_t i) {
+            users[i % userCount].payFines(0.0);
+        });
+
+        auto started = std::chrono::steady_clock::now();
+        uint64_t allocationsBefore = allocationCount;
+        librarian.displayInventory(inventory);
+        report(size, "displayInventory", inventory.size(), std::chrono::steady_clock::now() - started,
+               allocationCount - allocationsBefore);
     }
 
-    // Displays all books in inventory
-    void displayInventory(const std::vector<Book>& inventory) const {
-        std::cout << "\nLibrary Inventory:\n";
-        for (const auto& book : inventory) {
-            book.displayInfo();
-            std::cout << "-----------------\n";
+    // Borrow/return round trips through LibraryService from 1, 2, 4, ... threads,
+    // plus a contended run where every thread fights over one book
+    static void runConcurrent(size_t size) {
+        Library library(Librarian("Bench", "B001"));
+        LibraryService service(library);
+        std::vector<BookRecord> records(size);
+        for (size_t i = 0; i < size; ++i) {
+            records[i] = BookRecord{"Benchmark Title", "Benchmark Author", isbnFor(i)};
+        }
+        library.addBooks(records);
+        size_t userCount = 1024;
+        std::vector<std::string> userIDs(userCount);
+        for (size_t i = 0; i < userCount; ++i) {
+            userIDs[i] = "U" + std::to_string(i);
+            library.getUsers().add("Patron", userIDs[i]);
+        }
+
+        unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        const size_t totalOps = 400000;
+        time_t now = time(0);
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+            std::atomic<uint64_t> allocations(0);
+            auto started = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    uint64_t before = allocationCount;
+                    size_t rounds = totalOps / 2 / threads;
+                    for (size_t i = 0; i < rounds; ++i) {
+                        const std::string& ISBN = records[(t + i * threads) % size].ISBN;
+                        const std::string& userID = userIDs[(t + i * threads) % userCount];
+                        int64_t fine = 0;
+                        service.borrow(userID, ISBN, now);
+                        service.giveBack(userID, ISBN, now, fine);
+                    }
+                    allocations += allocationCount - before;
+                });
+            }
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+            std::string name = "service x" + std::to_string(threads);
+            report(size, name.c_str(), totalOps, std::chrono::steady_clock::now() - started, allocations);
+        }
+
+        // The same round trips in kiosk stacks of 16 books from every thread; figures are per book
+        {
+            const size_t stack = 16;
+            std::atomic<uint64_t> allocations(0);
+            std::atomic<size_t> refused(0);
+            auto started = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < maxThreads; ++t) {
+                workers.emplace_back([&, t] {
+                    std::vector<std::string> ISBNs(stack);
+                    uint64_t before = allocationCount;
+                    size_t rounds = totalOps / 2 / stack / maxThreads;
+                    for (size_t i = 0; i < rounds; ++i) {
+                        for (size_t j = 0; j < stack; ++j) {
+                            ISBNs[j] = records[((t + i * maxThreads) * stack + j) % size].ISBN;
+                        }
+                        const std::string& userID = userIDs[(t + i * maxThreads) % userCount];
+                        int64_t fine = 0;
+                        size_t failed = 0;
+                        if (service.borrowAll(userID, ISBNs, now, failed) != LoanResult::Ok ||
+                            service.giveBackAll(userID, ISBNs, now, fine, failed) != LoanResult::Ok) {
+                            ++refused;
+                        }
+                    }
+                    allocations += allocationCount - before;
+                });
+            }
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+            std::string name = "service batch x" + std::to_string(maxThreads);
+            report(size, name.c_str(), totalOps, std::chrono::steady_clock::now() - started, allocations);
+            if (size >= stack * maxThreads && refused != 0) {
+                std::fprintf(stdout, "%-10zu %-18s %zu refused batches!\n", size, "service batch",
+                             static_cast<size_t>(refused));
+            }
+        }
+
+        std::atomic<bool> held(false);
+        std::atomic<size_t> doubleBorrows(0);
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < std::max(2u, maxThreads); ++t) {
+            workers.emplace_back([&, t] {
+                for (size_t i = 0; i < 20000; ++i) {
+                    int64_t fine = 0;
+                    if (service.borrow(userIDs[t], records[0].ISBN, now) == LoanResult::Ok) {
+                        if (held.exchange(true)) {
+                            ++doubleBorrows;
+                        }
+                        held = false;
+                        service.giveBack(userIDs[t], records[0].ISBN, now, fine);
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        if (doubleBorrows != 0) {
+            std::fprintf(stdout, "%-10zu %-18s %zu double borrows!\n", size, "service contended",
+                         static_cast<size_t>(doubleBorrows));
+        }
+
+        // Reports during circulation: every view must be a consistent cut, where the
+        // books checked out match the loans the users hold
+        std::atomic<bool> circulating(true);
+        workers.clear();
+        for (unsigned t = 0; t < std::max(2u, maxThreads) - 1; ++t) {
+            workers.emplace_back([&, t] {
+                for (size_t i = 0; circulating; ++i) {
+                    const std::string& ISBN = records[(t + i * 7) % size].ISBN;
+                    int64_t fine = 0;
+                    service.borrow(userIDs[t], ISBN, now);
+                    if (i % 2 == 1) {
+                        service.giveBack(userIDs[t], ISBN, now, fine);
+                    }
+                }
+            });
+        }
+        size_t views = 0, torn = 0;
+        auto started = std::chrono::steady_clock::now();
+        uint64_t allocationsBefore = allocationCount;
+        for (; views < 200; ++views) {
+            std::shared_ptr<const CatalogView> view = service.report();
+            size_t checkedOut = 0, loans = 0;
+            view->forEachBook([&](const Title&, bool available, time_t, uint32_t) { checkedOut += !available; });
+            for (size_t u = 0; u < view->getUserCount(); ++u) {
+                loans += view->getLoanCount(u);
+            }
+            torn += checkedOut != loans;
+        }
+        report(size, "service report", views, std::chrono::steady_clock::now() - started,
+               allocationCount - allocationsBefore);
+        circulating = false;
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        if (torn != 0) {
+            std::fprintf(stdout, "%-10zu %-18s %zu inconsistent views!\n", size, "service report", torn);
         }
     }
 
-    // Displays user information including borrowed books
-    void displayUserInfo(const User& user) const {
-        user.displayInfo();
-        std::cout << "Borrowed Books:\n";
-        for (const auto book : user.getBorrowedBooks()) {
-            book->displayInfo();
-            std::cout << "-----------------\n";
+public:
+    // Runs a trace through a fresh library with output discarded, and reports the
+    // throughput and per-command latency (mean, p50, p99), so traces recorded or
+    // generated once can compare builds. Returns false if the trace cannot be read
+    static bool replay(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cout << "Cannot open trace file: " << path << "\n";
+            return false;
+        }
+        std::vector<std::string> lines, commands;
+        for (std::string line; std::getline(in, line);) {
+            size_t start = line.find_first_not_of(" \t");
+            size_t end = start == std::string::npos ? start : line.find_first_of(" \t\r", start);
+            commands.push_back(start == std::string::npos ? "" : line.substr(start, end - start));
+            lines.push_back(std::move(line));
+        }
+
+        Library library(Librarian("Bench", "B001"));
+        CommandDriver driver(library);
+        std::map<std::string, std::vector<uint64_t>> latencies;
+        for (const std::string& command : commands) {
+            if (!command.empty() && command[0] != '#') {
+                latencies[command].reserve(lines.size());
+            }
+        }
+        NullBuffer discard;
+        std::streambuf* console = std::cout.rdbuf(&discard);
+        size_t rejected = 0;
+        auto started = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < lines.size(); ++i) {
+            auto before = std::chrono::steady_clock::now();
+            bool ok = driver.execute(lines[i]);
+            auto after = std::chrono::steady_clock::now();
+            rejected += ok ? 0 : 1;
+            auto found = latencies.find(commands[i]);
+            if (found != latencies.end()) {
+                found->second.push_back(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()));
+            }
         }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cout.rdbuf(console);
+
+        std::fprintf(stdout, "%-10s %10s %12s %12s %12s\n", "command", "count", "ns/op", "p50 ns", "p99 ns");
+        size_t executed = 0;
+        for (auto& entry : latencies) {
+            std::vector<uint64_t>& times = entry.second;
+            if (times.empty()) {
+                continue;
+            }
+            executed += times.size();
+            double total = 0;
+            for (uint64_t ns : times) {
+                total += static_cast<double>(ns);
+            }
+            std::sort(times.begin(), times.end());
+            std::fprintf(stdout, "%-10s %10zu %12.1f %12llu %12llu\n", entry.first.c_str(), times.size(),
+                         total / times.size(), static_cast<unsigned long long>(times[times.size() / 2]),
+                         static_cast<unsigned long long>(times[std::min(times.size() - 1, times.size() * 99 / 100)]));
+        }
+        std::fprintf(stdout, "%zu commands (%zu rejected) in %.1f ms, %.0f ops/sec.\n", executed, rejected,
+                     seconds * 1000.0, seconds > 0 ? executed / seconds : 0.0);
+        return true;
+    }
+
+    // Runs every size 1e3, 1e4, ... up to maxSize; per-book figures for displayInventory
+    static void run(size_t maxSize) {
+        NullBuffer discard;
+        std::streambuf* console = std::cout.rdbuf(&discard);
+        std::mt19937_64 random(42);
+
+        noteAllocationCounting();
+        std::fprintf(stdout, "%-10s %-18s %12s %12s\n", "size", "operation", "ns/op", "allocs/op");
+        for (size_t size = 1000; size <= maxSize && size <= BookHandle::MaxSlots; size *= 10) {
+            runSize(size, random);
+            std::fflush(stdout);
+        }
+        runConcurrent(std::min<size_t>(maxSize, 100000));
+        std::cout.rdbuf(console);
     }
 };
 
+// File of branch for a --snapshot or --log path: the path itself for branch 0, path.N for branch N
+std::string branchFile(const std::string& path, size_t branch) {
+    return path.empty() || branch == 0 ? path : path + "." + std::to_string(branch);
+}
+
 /*
  * Main Function
- * Provides a menu-driven interface for the library system
+ * Handles command-line options, then provides a menu-driven interface
+ * for the library system
  */
-int main() {
-    std::vector<Book> inventory;  // Stores all books
-    std::vector<User> users;      // Stores all registered users
-    Librarian librarian("Admin", "L001");  // Default librarian
+int main(int argc, char* argv[]) {
+    // Command-line options run before the interactive menu
+    std::string snapshotPath, logPath, batchPath;
+    long servePort = -1;  // 0 asks the system for a free port
+    long branchCount = 1;
+    std::string generatePath, recordPath, replayPath;
+    size_t generateOps = 0;
+    WorkloadGenerator::Spec workload;
+    std::vector<std::string> importPaths;
+    long syncMillis = 100;
+    size_t benchMax = 0;
+    LoanPolicy defaultPolicy;
+    std::vector<std::pair<uint32_t, LoanPolicy>> classPolicies;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--import" && i + 1 < argc) {
+            importPaths.push_back(argv[++i]);
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshotPath = argv[++i];
+        } else if (arg == "--log" && i + 1 < argc) {
+            logPath = argv[++i];
+        } else if (arg == "--bench") {
+            benchMax = 1000000;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                benchMax = static_cast<size_t>(std::atof(argv[++i]));
+            }
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchPath = argv[++i];
+#ifdef __linux__
+        } else if (arg == "--serve" && i + 1 < argc) {
+            servePort = std::atol(argv[++i]);
+            if (servePort < 0 || servePort > 65535 || argv[i][0] < '0' || argv[i][0] > '9') {
+                std::cout << "Invalid port: " << argv[i] << "\n";
+                return 1;
+            }
+#endif
+        } else if (arg == "--branches" && i + 1 < argc) {
+            branchCount = std::atol(argv[++i]);
+            if (branchCount < 1 || branchCount > 1024) {
+                std::cout << "Invalid branch count: " << argv[i] << " (1-1024)\n";
+                return 1;
+            }
+        } else if (arg == "--generate" && i + 2 < argc) {
+            generatePath = argv[++i];
+            generateOps = static_cast<size_t>(std::atof(argv[++i]));
+        } else if (arg == "--workload" && i + 1 < argc) {
+            unsigned long long titles, patrons, seed = workload.seed;
+            if (std::sscanf(argv[++i], "%llu:%llu:%lf:%u:%u:%u:%llu", &titles, &patrons, &workload.skew,
+                            &workload.borrow, &workload.giveBack, &workload.pay, &seed) < 6 ||
+                titles == 0 || patrons == 0 || workload.skew < 0 ||
+                workload.borrow + workload.giveBack + workload.pay == 0) {
+                std::cout << "Usage: --workload titles:patrons:skew:borrow:return:pay[:seed]\n";
+                return 1;
+            }
+            workload.titles = static_cast<size_t>(titles);
+            workload.patrons = static_cast<size_t>(patrons);
+            workload.seed = seed;
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (arg == "--fsync-ms" && i + 1 < argc) {
+            syncMillis = std::max(0L, std::atol(argv[++i]));
+        } else if (arg == "--fine-rate" && i + 1 < argc) {
+            defaultPolicy.centsPerPeriod = std::max(0LL, std::atoll(argv[++i]));
+        } else if (arg == "--fine-period" && i + 1 < argc) {
+            defaultPolicy.periodSeconds = std::max(1LL, std::atoll(argv[++i]));
+        } else if (arg == "--loan-policy" && i + 1 < argc) {
+            unsigned long patronClass;
+            long long loan, grace, rate, period, cap = 0;
+            if (std::sscanf(argv[++i], "%lu:%lld:%lld:%lld:%lld:%lld", &patronClass, &loan, &grace,
+                            &rate, &period, &cap) < 5) {
+                std::cout << "Usage: --loan-policy class:loanSeconds:graceSeconds:centsPerPeriod:periodSeconds[:capCents]\n";
+                return 1;
+            }
+            classPolicies.emplace_back(static_cast<uint32_t>(std::min(patronClass, 0xFFFFFFFFul)),
+                                       LoanPolicy{loan, grace, rate, period, cap});
+        } else {
+            std::cout << "Usage: " << argv[0]
+                      << " [--snapshot library.snap] [--log library.log] [--fsync-ms N]"
+                         " [--fine-rate cents] [--fine-period seconds]"
+                         " [--loan-policy class:loan:grace:rate:period[:cap]]"
+                         " [--import catalog.csv|catalog.tsv] [--batch commands.txt|-] [--branches N]"
+#ifdef __linux__
+                         " [--serve port]"
+#endif
+                         " [--bench [max catalog size]] [--record trace.txt] [--replay trace.txt]"
+                         " [--generate trace.txt operations [--workload titles:patrons:skew:borrow:return:pay[:seed]]]\n";
+            return 1;
+        }
+    }
+
+#ifdef LMS_METRICS
+    Metrics::dumpOnSignal();
+#endif
+
+    if (benchMax != 0) {
+        Benchmark::run(benchMax);
+        return 0;
+    }
+    if (!replayPath.empty()) {
+        return Benchmark::replay(replayPath) ? 0 : 1;
+    }
+    if (!generatePath.empty()) {
+        std::ofstream trace(generatePath);
+        if (!trace) {
+            std::cout << "Cannot create trace file: " << generatePath << "\n";
+            return 1;
+        }
+        size_t written = WorkloadGenerator::write(trace, workload, generateOps);
+        std::cout << "Wrote " << written << " commands to " << generatePath << ".\n";
+        return trace ? 0 : 1;
+    }
+
+    // Headless runs write a lot of short lines; give stdout one large buffer instead of per-line flushes
+    static char outputBuffer[1 << 20];
+    if (!batchPath.empty() || servePort >= 0) {
+        std::ios::sync_with_stdio(false);
+        std::cout.rdbuf()->pubsetbuf(outputBuffer, sizeof(outputBuffer));
+        std::cin.tie(nullptr);
+    }
+
+    // Every branch shares the loan policies; the menu and --import work on branch 0
+    BranchNetwork network;
+    for (long i = 0; i < branchCount; ++i) {
+        network.addBranch(Librarian("Admin", "L001"));  // Default librarian
+    }
+    Library& library = network.getLibrary(0);
+    Inventory& inventory = library.getInventory();  // Stores all books, indexed by ISBN
+    UserDirectory& users = library.getUsers();      // Stores all registered users, indexed by userID
+
+    // Restore each branch's last snapshot and replay its log before importing anything new
+    for (size_t branch = 0; branch < network.size(); ++branch) {
+        Library& current = network.getLibrary(branch);
+        current.setLoanPolicy(0, defaultPolicy);
+        for (const auto& entry : classPolicies) {
+            if (!current.setLoanPolicy(entry.first, entry.second)) {
+                std::cout << "Invalid loan policy for patron class " << entry.first << " (classes are 0-"
+                          << LoanPolicyTable::MaxClasses - 1 << ", values non-negative, period positive).\n";
+                return 1;
+            }
+        }
+        auto started = std::chrono::steady_clock::now();
+        std::string branchLog = branchFile(logPath, branch);
+        if (!current.recover(branchFile(snapshotPath, branch), branchLog)) {
+            return 1;
+        }
+        if (!current.getInventory().empty() || !current.getUsers().empty()) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            std::cout << "Loaded " << current.getInventory().size() << " books and " << current.getUsers().size()
+                      << " users";
+            if (branch > 0) {
+                std::cout << " into branch " << branch;
+            }
+            std::cout << " in " << seconds * 1000.0 << " ms.\n";
+        }
+        if (!branchLog.empty() && !current.openLog(branchLog, std::chrono::milliseconds(syncMillis))) {
+            return 1;
+        }
+    }
+    auto saveSnapshots = [&]() {
+        for (size_t branch = 0; branch < network.size(); ++branch) {
+            std::string path = branchFile(snapshotPath, branch);
+            if (!path.empty() && network.getLibrary(branch).saveSnapshot(path)) {
+                std::cout << "Saved snapshot to " << path << ".\n";
+            }
+        }
+    };
+    for (const std::string& path : importPaths) {
+        if (!importCatalog(library, path)) {
+            return 1;
+        }
+    }
+    TraceRecorder recorder;
+    if (!recordPath.empty() && !recorder.open(recordPath)) {
+        return 1;
+    }
+
+#ifdef __linux__
+    if (servePort >= 0) {
+        RequestServer server(network);
+        server.setRecorder(recorder.isOpen() ? &recorder : nullptr);
+        if (!server.run(static_cast<uint16_t>(servePort))) {
+            return 1;
+        }
+        saveSnapshots();
+        return 0;
+    }
+#endif
+
+    if (!batchPath.empty()) {
+        CommandDriver driver(network);
+        driver.setRecorder(recorder.isOpen() ? &recorder : nullptr);
+        if (batchPath == "-") {
+            driver.run(std::cin);
+        } else {
+            std::ifstream commands(batchPath);
+            if (!commands) {
+                std::cout << "Cannot open command file: " << batchPath << "\n";
+                return 1;
+            }
+            driver.run(commands);
+        }
+        saveSnapshots();
+        return 0;
+    }
 
     int choice;
     do {
+        network.flushLogs();
+        recorder.flush();
+
         // Display menu options
         std::cout << "\nLibrary Management System\n";
         std::cout << "1. Add Book\n";
@@ -213,9 +6034,14 @@ int main() {
         std::cout << "6. Return Book\n";
         std::cout << "7. Pay Fines\n";
         std::cout << "8. Display User Info\n";
+        std::cout << "9. Show Overdue Notices\n";
+        std::cout << "10. Accrue Fines\n";
+        std::cout << "11. Search Catalog\n";
         std::cout << "0. Exit\n";
         std::cout << "Enter choice: ";
-        std::cin >> choice;
+        if (!(std::cin >> choice)) {
+            choice = 0;  // End of input (or unreadable input) exits
+        }
 
         switch(choice) {
             case 1: {  // Add Book
@@ -227,7 +6053,8 @@ int main() {
                 std::getline(std::cin, author);
                 std::cout << "Enter ISBN: ";
                 std::getline(std::cin, ISBN);
-                librarian.addBook(inventory, title, author, ISBN);
+                recorder.record("ADD " + ISBN + " " + title + "|" + author);
+                library.addBook(title, author, ISBN);
                 break;
             }
             case 2: {  // Remove Book
@@ -235,12 +6062,35 @@ int main() {
                 std::cout << "Enter ISBN of book to remove: ";
                 std::cin.ignore();
                 std::getline(std::cin, ISBN);
-                librarian.removeBook(inventory, ISBN);
+                recorder.record("REMOVE " + ISBN);
+                library.removeBook(ISBN);
                 break;
             }
-            case 3:  // Display Inventory
-                librarian.displayInventory(inventory);
+            case 3: {  // Display Inventory, a page at a time
+                InventoryPage page;
+                int filter;
+                std::cout << "Show 0. All  1. Available  2. Checked out: ";
+                std::cin >> filter;
+                page.filter = filter == 1 ? InventoryPage::Filter::Available
+                            : filter == 2 ? InventoryPage::Filter::CheckedOut
+                                          : InventoryPage::Filter::All;
+                page.limit = 20;
+                const char* filterName = filter == 1 ? "available" : filter == 2 ? "out" : "all";
+                char more = 'y';
+                while (more == 'y' || more == 'Y') {
+                    recorder.record("LIST " + std::string(filterName) + " " + std::to_string(page.offset) + " " +
+                                    std::to_string(page.limit));
+                    page.offset = library.getLibrarian().displayInventory(inventory, page);
+                    if (page.offset >= inventory.size()) {
+                        break;
+                    }
+                    std::cout << "Show more? (y/n): ";
+                    if (!(std::cin >> more)) {
+                        break;
+                    }
+                }
                 break;
+            }
             case 4: {  // Register User
                 std::string name, userID;
                 std::cout << "Enter user name: ";
@@ -248,8 +6098,8 @@ int main() {
                 std::getline(std::cin, name);
                 std::cout << "Enter user ID: ";
                 std::getline(std::cin, userID);
-                users.emplace_back(name, userID);
-                std::cout << "User registered successfully.\n";
+                recorder.record("REGISTER " + userID + " " + name);
+                library.registerUser(name, userID);
                 break;
             }
             case 5: {  // Borrow Book
@@ -266,17 +6116,39 @@ int main() {
                 size_t userIndex;
                 std::cin >> userIndex;
 
-                // Select book
-                std::cout << "Select book (0-" << inventory.size()-1 << "):\n";
-                for (size_t i = 0; i < inventory.size(); ++i) {
-                    std::cout << i << ". " << inventory[i].getTitle() << "\n";
+                // Find the book by title/author, or list everything if no words are given
+                std::string query;
+                std::cout << "Search title/author (blank lists all books): ";
+                std::cin.ignore();
+                std::getline(std::cin, query);
+                std::vector<Title*> matches;
+                if (query.find_first_not_of(" \t") != std::string::npos) {
+                    library.getLibrarian().searchCatalog(inventory, query, matches);
+                } else {
+                    for (size_t i = 0; i < inventory.size(); ++i) {
+                        Title* record = inventory[i].getRecord();
+                        if (record->getCopies()[0] == &inventory[i]) {  // Once per title
+                            std::cout << matches.size() << ". " << record->getTitle() << "\n";
+                            matches.push_back(record);
+                        }
+                    }
+                }
+                if (matches.empty()) {
+                    break;
                 }
+
+                // Select book
+                std::cout << "Select book (0-" << matches.size()-1 << "): ";
                 size_t bookIndex;
                 std::cin >> bookIndex;
 
                 // Process borrowing
-                if (userIndex < users.size() && bookIndex < inventory.size()) {
-                    users[userIndex].borrowBook(&inventory[bookIndex]);
+                if (userIndex < users.size() && bookIndex < matches.size()) {
+                    // Any shelved copy will do; if none is, the borrow reports it checked out
+                    recorder.record("BORROW " + std::string(users[userIndex].getUserID()) + " " +
+                                    std::string(matches[bookIndex]->getISBN()));
+                    library.borrowBook(userIndex, matches[bookIndex]->anyCopy());
+                    library.announceHolds(userIndex);
                 } else {
                     std::cout << "Invalid selection.\n";
                 }
@@ -310,14 +6182,18 @@ int main() {
 
                 std::cout << "Select book to return (0-" << borrowed.size()-1 << "):\n";
                 for (size_t i = 0; i < borrowed.size(); ++i) {
-                    std::cout << i << ". " << borrowed[i]->getTitle() << "\n";
+                    std::cout << i << ". " << inventory.get(borrowed[i])->getTitle() << "\n";
                 }
                 size_t bookIndex;
                 std::cin >> bookIndex;
 
                 // Process return
                 if (bookIndex < borrowed.size()) {
-                    users[userIndex].returnBook(borrowed[bookIndex]);
+                    Book* book = inventory.get(borrowed[bookIndex]);
+                    recorder.record("RETURN " + std::string(users[userIndex].getUserID()) + " " +
+                                    std::string(book->getISBN()));
+                    library.returnBook(userIndex, book);
+                    library.announceHolds(userIndex);
                 } else {
                     std::cout << "Invalid book selection.\n";
                 }
@@ -343,7 +6219,10 @@ int main() {
                     double amount;
                     std::cout << "Enter amount to pay: $";
                     std::cin >> amount;
-                    users[userIndex].payFines(amount);
+                    recorder.record("PAY " + std::string(users[userIndex].getUserID()) + " " +
+                                    formatCents(std::llround(amount * 100.0)));
+                    library.payFines(userIndex, amount);
+                    library.announceHolds(userIndex);
                 } else {
                     std::cout << "Invalid selection.\n";
                 }
@@ -365,13 +6244,34 @@ int main() {
 
                 // Display info
                 if (userIndex < users.size()) {
-                    librarian.displayUserInfo(users[userIndex]);
+                    recorder.record("INFO " + std::string(users[userIndex].getUserID()));
+                    library.getLibrarian().displayUserInfo(users[userIndex], inventory);
+                    library.announceHolds(userIndex);
                 } else {
                     std::cout << "Invalid selection.\n";
                 }
                 break;
             }
+            case 9:  // Show Overdue Notices
+                recorder.record("OVERDUE");
+                library.reportOverdue(time(0));
+                break;
+            case 10:  // Accrue Fines
+                recorder.record("ACCRUE");
+                library.accrueFines(time(0));
+                break;
+            case 11: {  // Search Catalog
+                std::string query;
+                std::cout << "Enter title/author words (end a word with * to match a prefix): ";
+                std::cin.ignore();
+                std::getline(std::cin, query);
+                recorder.record("SEARCH " + query);
+                std::vector<Title*> matches;
+                library.getLibrarian().searchCatalog(inventory, query, matches);
+                break;
+            }
             case 0:  // Exit
+                saveSnapshots();
                 std::cout << "Exiting...\n";
                 break;
             default:  // Invalid choice
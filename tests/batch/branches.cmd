@@ -0,0 +1,21 @@
+# Each branch keeps its own catalog and patrons; LOCATE searches every branch
+ADD 9780306406157 Shared|Author
+ADD 9780804429573 Main Only|Author
+REGISTER U1 Main Patron
+BRANCH 1
+ADD 9780306406157 Shared|Author
+ADD 9780306406157 Shared|Author
+REGISTER U1 North Patron
+REGISTER U2 North Patron Two
+BORROW U1 9780306406157
+BORROW U2 9780306406157
+BORROW U2 9780306406157
+BRANCH 2
+INFO U1
+LOCATE 9780306406157
+LOCATE 0-8044-2957-X
+LOCATE 9781861972712
+BRANCH 0
+STATS
+BRANCH 3
+BRANCH
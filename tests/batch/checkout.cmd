@@ -0,0 +1,17 @@
+# CHECKOUT and CHECKIN take the whole stack or nothing
+ADD 9780306406157 First|Author
+ADD 9780804429573 Second|Author
+ADD 9781861972712 Third|Author
+REGISTER U1 Kiosk Patron
+REGISTER U2 Other Patron
+BORROW U2 9781861972712
+CHECKOUT U1 9780306406157 9780804429573 9781861972712
+CHECKOUT U1 9780306406157 9780306406157
+CHECKOUT U1 9780306406157 9780131103627
+INFO U1
+LIST out
+CHECKOUT U1 9780306406157 9780804429573
+CHECKIN U1 9780306406157 9781861972712
+LIST out
+CHECKIN U1 9780804429573 9780306406157
+LIST out
@@ -0,0 +1,19 @@
+# Holds queue oldest first; each return hands the copy to the next patron in line, who hears of it in their next command
+ADD 9780306406157 Popular|Author
+REGISTER A First
+REGISTER B Second
+REGISTER C Third
+BORROW A 9780306406157
+BORROW B 9780306406157
+BORROW C 9780306406157
+BORROW B 9780306406157
+RETURN A 9780306406157
+INFO B
+BORROW A 9780306406157
+RETURN B 9780306406157
+INFO C
+RETURN C 9780306406157
+INFO A
+RETURN A 9780306406157
+RETURN A 9780306406157
+LIST available
@@ -0,0 +1,17 @@
+# Malformed ISBNs are rejected everywhere an ISBN is read
+ADD 978000000X008 X Inside|Nobody
+ADD 080442957X1 X Then Digit|Nobody
+ADD 080442957XX Two Xs|Nobody
+ADD 80442957X Nine Digits|Nobody
+ADD 9780306406158 Bad Checksum|Nobody
+ADD 97803064061570 Fourteen Digits|Nobody
+ADD 9770306406157 Wrong Prefix|Nobody
+ADD 97803064O6157 Letter O|Nobody
+ADD 978-0-306-40615-7 Hyphenated|Someone
+ADD 0-8044-2957-x Lower X|Someone
+ADD 9780804429573 Same As Lower X|Someone
+REGISTER U1 Reader
+BORROW U1 978000000X008
+RETURN U1 080442957X1
+REMOVE 80442957X
+LIST
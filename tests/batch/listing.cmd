@@ -0,0 +1,22 @@
+# LIST pages through the inventory: offsets, limits and the available/out filters
+ADD 9780306406157 First|Author
+ADD 9780804429573 Second|Author
+ADD 9781861972712 Third|Author
+ADD 9780131103627 Fourth|Author
+REGISTER U1 Reader
+BORROW U1 9780804429573
+BORROW U1 9780131103627
+LIST all 0 2
+LIST all 2 2
+LIST 1 1
+LIST available
+LIST out
+LIST available 1 5
+LIST out 0 1
+LIST all 3
+LIST all 4
+LIST 10
+LIST all 0 0
+LIST 1 0
+LIST sideways
+LIST 0 x
@@ -0,0 +1,26 @@
+# SEARCH: every term must match, case folds, a trailing * matches a prefix,
+# and the index follows REMOVE and WEED
+ADD 9780306406157 The Art of Computer Programming|Donald Knuth
+ADD 9780306406157 The Art of Computer Programming|Donald Knuth
+ADD 9780804429573 Concrete Mathematics|Ronald Graham
+ADD 9781861972712 Computer Networks|Andrew Tanenbaum
+ADD 9780131103627 The C Programming Language|Brian Kernighan
+SEARCH programming
+SEARCH PROGRAMMING knuth
+SEARCH comp*
+SEARCH comp* networks
+SEARCH prog* language
+SEARCH art mathematics
+SEARCH nosuchword
+SEARCH co*
+REMOVE 9780306406157
+SEARCH knuth
+REMOVE 9780306406157
+SEARCH knuth
+SEARCH programming
+WEED 9781861972712 9780804429573
+SEARCH comp*
+SEARCH graham
+ADD 9781861972712 Computer Networks|Andrew Tanenbaum
+SEARCH tanen*
+SEARCH
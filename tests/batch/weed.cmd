@@ -0,0 +1,16 @@
+# WEED removes every shelved copy of each ISBN in one pass; loans are kept
+ADD 9780306406157 First|Author
+ADD 9780306406157 First|Author
+ADD 9780804429573 Second|Author
+ADD 9781861972712 Third|Author
+ADD 9780131103627 Fourth|Author
+REGISTER U1 Reader
+BORROW U1 9780306406157
+WEED 9780306406157 9781861972712 9780306406157 9780000000002 123
+LIST
+SEARCH third
+STATS
+RETURN U1 9780306406157
+WEED 9780306406157
+LIST
+WEED
@@ -0,0 +1,5 @@
+# One borrow, then the Prometheus text for it
+ADD 9780306406157 Counted|Author
+REGISTER M Metered
+BORROW M 9780306406157
+METRICS
@@ -0,0 +1,130 @@
+#!/bin/sh
+# Regression checks. Builds the program and the service test, runs every
+# tests/batch/NAME.cmd through --batch (with the options in NAME.args, if
+# any) and compares stdout with NAME.out, replays a torn operation log
+# (tests/wal), checks a generated and a recorded trace and the METRICS
+# output of a -DLMS_METRICS build (tests/metrics), talks to --serve over
+# TCP (tests/serve; Linux, needs bash), then runs the threaded service
+# test. Set CXXFLAGS to add sanitizers, e.g.
+#   CXXFLAGS="-std=c++17 -g -O1 -pthread -fsanitize=thread" tests/run.sh
+set -u
+cd "$(dirname "$0")/.."
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++17 -O2 -pthread"}
+BUILD=${BUILD:-tests/build}
+mkdir -p "$BUILD"
+# shellcheck disable=SC2086
+$CXX $CXXFLAGS project2.cpp -o "$BUILD/project2" || exit 1
+# shellcheck disable=SC2086
+$CXX $CXXFLAGS tests/service_test.cpp -o "$BUILD/service_test" || exit 1
+
+failed=0
+pass() { echo "ok   $1"; }
+fail() { echo "FAIL $1"; failed=$((failed + 1)); }
+
+# Batch scenarios with expected output; NAME.args, if present, holds extra options
+for commands in tests/batch/*.cmd; do
+    [ -e "$commands" ] || continue
+    name=$(basename "$commands" .cmd)
+    args=
+    [ -e "tests/batch/$name.args" ] && args=$(cat "tests/batch/$name.args")
+    # shellcheck disable=SC2086
+    if "$BUILD/project2" $args --batch "$commands" 2>/dev/null | diff -u "tests/batch/$name.out" - >"$BUILD/$name.diff"; then
+        pass "$name"
+    else
+        fail "$name (see $BUILD/$name.diff)"
+    fi
+done
+
+# A log torn mid-record replays to the state of the commands it holds in full,
+# and the snapshot saved from that state reloads to the same listing
+wal=$BUILD/wal
+rm -rf "$wal" && mkdir -p "$wal"
+sed '$d' tests/wal/mutations.cmd >"$wal/complete.cmd"
+"$BUILD/project2" --log "$wal/full.log" --batch tests/wal/mutations.cmd >/dev/null 2>&1
+size=$(wc -c <"$wal/full.log")
+head -c $((size - 5)) "$wal/full.log" >"$wal/torn.log"
+state() { "$BUILD/project2" "$@" --batch tests/wal/state.cmd 2>/dev/null | grep -v '^Loaded \|^Saved snapshot\|^Replayed '; }
+"$BUILD/project2" --snapshot "$wal/expected.snap" --batch "$wal/complete.cmd" >/dev/null 2>&1
+state --snapshot "$wal/expected.snap" >"$wal/expected.txt"
+state --log "$wal/torn.log" --snapshot "$wal/replayed.snap" >"$wal/replayed.txt"
+state --snapshot "$wal/replayed.snap" >"$wal/reloaded.txt"
+if grep -q '^Operation log has a torn tail' "$wal/replayed.txt" &&
+   grep -v '^Operation log has a torn tail' "$wal/replayed.txt" | diff -u "$wal/expected.txt" - >"$wal/replay.diff" &&
+   diff -u "$wal/expected.txt" "$wal/reloaded.txt" >"$wal/reload.diff"; then
+    pass wal_torn_tail
+else
+    fail "wal_torn_tail (see $wal)"
+fi
+
+# A generated workload only returns books its patrons hold, never queues a patron
+# twice and pays real amounts, and recording a batch or menu session (tests/trace/menu.in)
+# gives back its commands
+trace=$BUILD/trace
+rm -rf "$trace" && mkdir -p "$trace"
+"$BUILD/project2" --generate "$trace/generated.txt" 20000 --workload 500:50:1.2:60:35:5:3 >/dev/null
+"$BUILD/project2" --record "$trace/recorded.txt" --batch tests/batch/checkout.cmd >/dev/null 2>&1
+"$BUILD/project2" --record "$trace/menu.txt" <tests/trace/menu.in >/dev/null 2>&1
+grep -v '^#' tests/batch/checkout.cmd >"$trace/commands.txt"
+if "$BUILD/project2" --batch "$trace/generated.txt" 2>"$trace/summary.txt" >"$trace/output.txt" &&
+   grep -q '(0 rejected)' "$trace/summary.txt" &&
+   ! grep -q "^Already waiting\|^You didn't borrow" "$trace/output.txt" &&
+   grep -q '^PAY P[0-9]* [0-9]*\.[0-9][0-9]$' "$trace/generated.txt" &&
+   ! grep -q '^PAY P[0-9]* 0*\.*0*$' "$trace/generated.txt" &&
+   diff -u "$trace/commands.txt" "$trace/recorded.txt" >"$trace/recorded.diff" &&
+   diff -u tests/trace/menu.cmd "$trace/menu.txt" >"$trace/menu.diff"; then
+    pass workload_trace
+else
+    fail "workload_trace (see $trace)"
+fi
+
+# A metrics build reports exactly the one borrow, in a histogram Prometheus can scrape
+metrics=$BUILD/metrics
+rm -rf "$metrics" && mkdir -p "$metrics"
+# shellcheck disable=SC2086
+if $CXX $CXXFLAGS -DLMS_METRICS project2.cpp -o "$metrics/project2" &&
+   "$metrics/project2" --batch tests/metrics/borrow.cmd >"$metrics/output.txt" 2>/dev/null &&
+   grep -q '^# TYPE lms_operation_latency_seconds histogram$' "$metrics/output.txt" &&
+   grep -q '^lms_operation_latency_seconds_bucket{op="borrow",le="+Inf"} 1$' "$metrics/output.txt" &&
+   grep -q '^lms_operation_latency_seconds_count{op="borrow"} 1$' "$metrics/output.txt" &&
+   grep -q '^lms_operation_latency_seconds_count{op="return"} 0$' "$metrics/output.txt"; then
+    pass metrics
+else
+    fail "metrics (see $metrics)"
+fi
+
+# A client on an ephemeral port gets each command's output and status line, nothing
+# after its QUIT runs, and SIGTERM stops the server cleanly
+if [ "$(uname)" = Linux ] && command -v bash >/dev/null; then
+    serve=$BUILD/serve
+    rm -rf "$serve" && mkdir -p "$serve"
+    "$BUILD/project2" --serve 0 >"$serve/server.txt" 2>&1 &
+    server=$!
+    port=
+    for _ in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+        port=$(sed -n 's/^Serving on port \([0-9]*\)\.$/\1/p' "$serve/server.txt")
+        [ -n "$port" ] && break
+        sleep 0.25
+    done
+    [ -n "$port" ] &&
+        timeout 10 bash -c 'exec 3<>"/dev/tcp/127.0.0.1/$1" && cat "$2" >&3 && cat <&3' _ "$port" \
+            tests/serve/session.cmd >"$serve/client.txt" 2>&1
+    kill -TERM "$server" 2>/dev/null
+    wait "$server"
+    status=$?
+    if [ "$status" -eq 0 ] && diff -u tests/serve/session.out "$serve/client.txt" >"$serve/client.diff" &&
+       grep -q '^Stopped serving; 0 clients disconnected\.$' "$serve/server.txt"; then
+        pass serve
+    else
+        fail "serve (see $serve)"
+    fi
+fi
+
+if "$BUILD/service_test"; then
+    pass service_test
+else
+    fail service_test
+fi
+
+[ "$failed" -eq 0 ] || { echo "$failed failed"; exit 1; }
+echo "all passed"
@@ -0,0 +1,7 @@
+ADD 9780306406157 Served|Author
+REGISTER S Remote
+BORROW S 9780306406157
+BORROW S
+LIST out
+QUIT
+REGISTER T Never
@@ -0,0 +1,614 @@
+/*
+ * LibraryService Tests
+ * Checks of the sharded service that the batch cases cannot reach:
+ * threaded races, and caller-supplied times that the batch driver never
+ * repeats or reorders. The whole program is compiled in with its main
+ * renamed; build with -fsanitize=thread to have data races reported too
+ */
+#include <condition_variable>
+#include <sstream>
+
+#define main lmsMain
+#include "../project2.cpp"
+#undef main
+
+// The service's catalog and stats calls hold all 64 shard locks at once, past the
+// limit of TSan's deadlock detector; data race reports are unaffected
+extern "C" const char* __tsan_default_options() { return "detect_deadlocks=0"; }
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+// Books and patrons are set up through the Library before any thread starts
+static std::string isbnFor(size_t i) { return std::to_string(Isbn::fromPrefix(978000000000ULL + i)); }
+
+// Desks race to borrow the only copy; at most one patron may hold it at a time
+static void testDoubleBorrow() {
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    library.addBook("Only Copy", "Author", isbnFor(1));
+    const size_t desks = 8, rounds = 2000;
+    for (size_t i = 0; i < desks; ++i) {
+        library.registerUser("Patron " + std::to_string(i), "D" + std::to_string(i));
+    }
+    std::atomic<int> holders{0}, overlaps{0};
+    std::atomic<size_t> wins{0};
+    std::vector<std::thread> threads;
+    for (size_t desk = 0; desk < desks; ++desk) {
+        threads.emplace_back([&, desk] {
+            std::string userID = "D" + std::to_string(desk);
+            for (size_t round = 0; round < rounds; ++round) {
+                if (service.borrow(userID, isbnFor(1), 1000) != LoanResult::Ok) {
+                    continue;
+                }
+                if (holders.fetch_add(1) != 0) {
+                    ++overlaps;
+                }
+                ++wins;
+                holders.fetch_sub(1);
+                int64_t fine = 0;
+                if (service.giveBack(userID, isbnFor(1), 1000, fine) != LoanResult::Ok) {
+                    ++overlaps;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    expect(overlaps == 0, "double borrow: two patrons held the only copy at once");
+    expect(wins > 0, "double borrow: no borrow ever succeeded");
+    expect(service.isAvailable(isbnFor(1)), "double borrow: the copy was not back on the shelf");
+}
+
+// One patron keeps trying to return a book another patron holds, while that borrower's
+// own returns keep moving the book to a different loan slot
+static void testForeignReturn() {
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    library.addBook("Moved Loan", "Author", isbnFor(2));
+    library.addBook("Other Loan", "Author", isbnFor(3));
+    library.registerUser("Owner", "OWNER");
+    library.registerUser("Stranger", "STRANGER");
+    const size_t rounds = 5000;
+    std::atomic<size_t> stolen{0};
+    std::thread stranger([&] {
+        for (size_t round = 0; round < rounds; ++round) {
+            int64_t fine = 0;
+            if (service.giveBack("STRANGER", isbnFor(2), 1000, fine) == LoanResult::Ok) {
+                ++stolen;
+            }
+        }
+    });
+    std::thread owner([&] {
+        for (size_t round = 0; round < rounds; ++round) {
+            int64_t fine = 0;
+            service.borrow("OWNER", isbnFor(3), 1000);
+            service.borrow("OWNER", isbnFor(2), 1000);
+            service.giveBack("OWNER", isbnFor(3), 1000, fine);  // Moves the other loan into slot 0
+            service.giveBack("OWNER", isbnFor(2), 1000, fine);
+        }
+    });
+    stranger.join();
+    owner.join();
+    expect(stolen == 0, "foreign return: a patron returned a book someone else held");
+}
+
+// Two kiosks check out overlapping stacks; each checkout takes its whole stack or none
+static void testOverlappingStacks() {
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    for (size_t i = 10; i < 14; ++i) {
+        library.addBook("Stacked", "Author", isbnFor(i));
+    }
+    library.registerUser("Left", "LEFT");
+    library.registerUser("Right", "RIGHT");
+    const size_t rounds = 3000;
+    std::atomic<size_t> partial{0}, completed{0};
+    auto kiosk = [&](const std::string& userID, std::vector<std::string> stack) {
+        for (size_t round = 0; round < rounds; ++round) {
+            size_t failed = 0, loans = 0;
+            int64_t fine = 0, fines = 0;
+            bool borrowed = service.borrowAll(userID, stack, 1000, failed) == LoanResult::Ok;
+            service.lookupUser(userID, fines, loans);
+            if (loans != (borrowed ? stack.size() : 0)) {
+                ++partial;
+            }
+            if (borrowed) {
+                ++completed;
+                if (service.giveBackAll(userID, stack, 1000, fine, failed) != LoanResult::Ok) {
+                    ++partial;
+                }
+            }
+        }
+    };
+    std::thread left(kiosk, "LEFT", std::vector<std::string>{isbnFor(10), isbnFor(11), isbnFor(12)});
+    std::thread right(kiosk, "RIGHT", std::vector<std::string>{isbnFor(12), isbnFor(13)});
+    left.join();
+    right.join();
+    expect(partial == 0, "overlapping stacks: a checkout left part of its stack borrowed");
+    expect(completed > 0, "overlapping stacks: no checkout ever succeeded");
+    for (size_t i = 10; i < 14; ++i) {
+        expect(service.isAvailable(isbnFor(i)), "overlapping stacks: a copy was left checked out");
+    }
+}
+
+// Books a view shows checked out, and the loans its users hold; one captured point in
+// time must agree on both
+static void countView(const CatalogView& view, size_t& checkedOut, size_t& loans) {
+    checkedOut = loans = 0;
+    view.forEachBook([&](auto&&, bool available, auto&&, auto&&) { checkedOut += available ? 0 : 1; });
+    for (size_t i = 0; i < view.getUserCount(); ++i) {
+        loans += view.getLoanCount(i);
+    }
+}
+
+// A captured view keeps its point in time while circulation carries on, and views
+// captured during it are each consistent
+static void testCatalogViews() {
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    const size_t books = 64, desks = 4;
+    for (size_t i = 0; i < books; ++i) {
+        library.addBook("Viewed", "Author", isbnFor(100 + i));
+    }
+    for (size_t desk = 0; desk < desks; ++desk) {
+        library.registerUser("Desk", "V" + std::to_string(desk));
+    }
+
+    size_t checkedOut, loans;
+    std::shared_ptr<const CatalogView> before = service.report();
+    service.borrow("V0", isbnFor(100), 1000);
+    std::shared_ptr<const CatalogView> after = service.report();
+    countView(*before, checkedOut, loans);
+    expect(checkedOut == 0 && loans == 0, "views: an earlier view saw a later borrow");
+    countView(*after, checkedOut, loans);
+    expect(checkedOut == 1 && loans == 1, "views: a new view missed the borrow");
+    int64_t fine = 0;
+    service.giveBack("V0", isbnFor(100), 1000, fine);
+
+    std::atomic<bool> done{false};
+    std::atomic<size_t> torn{0};
+    std::thread reader([&] {
+        while (!done) {
+            size_t out, held;
+            countView(*service.report(), out, held);
+            if (out != held) {
+                ++torn;
+            }
+        }
+    });
+    std::vector<std::thread> threads;
+    for (size_t desk = 0; desk < desks; ++desk) {
+        threads.emplace_back([&, desk] {
+            std::string userID = "V" + std::to_string(desk);
+            for (size_t round = 0; round < 2000; ++round) {
+                std::string ISBN = isbnFor(100 + (round * desks + desk) % books);
+                int64_t charged = 0;
+                if (service.borrow(userID, ISBN, 1000) == LoanResult::Ok) {
+                    service.giveBack(userID, ISBN, 1000, charged);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    done = true;
+    reader.join();
+    expect(torn == 0, "views: a view's loans and checked-out books disagreed");
+}
+
+// A listing without its "Listing paused" lines, whose cursors differ between the live
+// inventory (after the last book shown) and a view (the first book of the next page)
+static std::string withoutPauses(const std::string& listing) {
+    std::istringstream lines(listing);
+    std::string out;
+    for (std::string line; std::getline(lines, line);) {
+        if (line.compare(0, 18, "Listing paused at ") != 0) {
+            out.append(line).append("\n");
+        }
+    }
+    return out;
+}
+
+// Paging a view gives the same listing as paging the live inventory, including past
+// a page emptied by weeding, and stops where the page is full
+static void testViewPaging() {
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    const size_t books = 2 * CatalogView::PageSize + 500;
+    for (size_t i = 0; i < books; ++i) {
+        library.addBook("Paged", "Author", isbnFor(1000 + i));
+    }
+    library.registerUser("Pager", "G");
+    std::vector<std::string> weeded;
+    for (size_t i = 0; i < CatalogView::PageSize + 10; ++i) {
+        weeded.push_back(isbnFor(1000 + i));
+    }
+    std::vector<BookHandle> removed;
+    size_t missing;
+    library.getInventory().removeAll(weeded, removed, missing);
+    for (size_t i = CatalogView::PageSize + 10; i < books; i += 3) {
+        service.borrow("G", isbnFor(1000 + i), 1000);
+    }
+    std::shared_ptr<const CatalogView> view = service.report();
+
+    const Librarian& librarian = library.getLibrarian();
+    const InventoryPage::Filter filters[] = {InventoryPage::Filter::All, InventoryPage::Filter::Available,
+                                             InventoryPage::Filter::CheckedOut};
+    for (InventoryPage::Filter filter : filters) {
+        std::ostringstream live, viewed;
+        std::streambuf* console = std::cout.rdbuf(live.rdbuf());
+        InventoryPage page;
+        page.filter = filter;
+        page.limit = 97;
+        size_t livePages = 0, viewPages = 0;
+        for (page.offset = 0; page.offset < library.getInventory().size(); ++livePages) {
+            page.offset = librarian.displayInventory(library.getInventory(), page);
+        }
+        std::cout.rdbuf(viewed.rdbuf());
+        for (page.offset = 0; page.offset < view->getBookCount(); ++viewPages) {
+            page.offset = librarian.displayInventory(*view, page);
+        }
+        std::cout.rdbuf(console);
+        expect(livePages == viewPages && withoutPauses(live.str()) == withoutPauses(viewed.str()),
+               "paging: a view listed differently from the inventory");
+    }
+}
+
+
+// Returning and re-borrowing at the same instant gives the new loan the old due date;
+// the loan must still be reported overdue once
+static void testReborrowSameDue() {
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    library.addBook("Reborrowed", "Author", isbnFor(4));
+    library.registerUser("Patron", "P1");
+    int64_t fine = 0;
+    service.borrow("P1", isbnFor(4), 1000);
+    service.giveBack("P1", isbnFor(4), 1000, fine);
+    service.borrow("P1", isbnFor(4), 1000);
+    std::vector<OverdueTracker::Notice> notices;
+    library.collectOverdue(5000, notices);
+    expect(notices.size() == 1, "re-borrow: the loan was not reported exactly once");
+    expect(service.stats(5000).overdueBooks == 1, "re-borrow: overdue count is not 1");
+}
+
+// A filled hold is queued for the waiting patron rather than printed by whichever
+// desk returned the copy
+static void testHoldNoticeDelivery() {
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    library.addBook("Wanted", "Author", isbnFor(11));
+    library.registerUser("Lender", "P1");
+    library.registerUser("Waiter", "P2");
+    service.borrow("P1", isbnFor(11), 1000);
+    service.placeHold("P2", isbnFor(11), 1000);
+    std::ostringstream captured;
+    std::streambuf* console = std::cout.rdbuf(captured.rdbuf());
+    int64_t fine = 0;
+    service.giveBack("P1", isbnFor(11), 1000, fine);
+    std::cout.rdbuf(console);
+    expect(captured.str().find("Hold ready") == std::string::npos,
+           "holds: the returning desk printed the waiting patron's notice");
+    std::vector<BookHandle> ready;
+    expect(service.takeReadyHolds("P2", ready) && ready.size() == 1,
+           "holds: the waiting patron was not told of the filled hold");
+    ready.clear();
+    service.takeReadyHolds("P2", ready);
+    expect(ready.empty(), "holds: a notice was delivered twice");
+}
+
+// A patron past the inline loans spills into the pool and moves back inline as they
+// return; assigning over a spilled list hands its block back to the pool
+static void testLoanListSpill() {
+    const size_t Loans = LoanList::InlineCapacity + 4;
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    library.registerUser("Reader", "P1");
+    for (size_t i = 0; i < Loans; ++i) {
+        library.addBook("Stack", "Author", isbnFor(20 + i));
+        expect(service.borrow("P1", isbnFor(20 + i), 1000) == LoanResult::Ok, "spill: a borrow failed");
+    }
+    const LoanList& loans = library.getUsers()[0].getBorrowedBooks();
+    expect(loans.size() == Loans, "spill: the pooled list lost a loan");
+    for (size_t i = 0; i < Loans; ++i) {
+        Book* book = library.getInventory().find(isbnFor(20 + i));
+        expect(std::find(loans.begin(), loans.end(), book->getHandle()) != loans.end(),
+               "spill: a loan is missing after spilling");
+    }
+
+    LoanList copy = loans;
+    const BookHandle* block = copy.begin();
+    copy = LoanList();
+    BookHandle* reused = LoanPool::shared().allocate(LoanList::InlineCapacity + 1);
+    expect(reused == block && copy.empty(), "spill: assignment did not release the pooled block");
+    LoanPool::shared().release(reused, LoanList::InlineCapacity + 1);
+
+    int64_t fine = 0;
+    for (size_t i = 0; i < Loans; ++i) {
+        expect(service.giveBack("P1", isbnFor(20 + i), 1000, fine) == LoanResult::Ok, "spill: a return failed");
+    }
+    expect(loans.empty(), "spill: loans remain after returning everything");
+    expect(service.borrow("P1", isbnFor(20), 1000) == LoanResult::Ok && loans.size() == 1 && loans[0] ==
+           library.getInventory().find(isbnFor(20))->getHandle(), "spill: the list is unusable back inline");
+}
+
+// Desks pass their own times, so a loan can start "before" the last collection; ending
+// it must not uncount a loan that was never counted
+static void testOverdueCountOrder() {
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    library.addBook("Counted", "Author", isbnFor(5));
+    library.addBook("Uncounted", "Author", isbnFor(6));
+    library.registerUser("Patron", "P1");
+    int64_t fine = 0;
+    service.borrow("P1", isbnFor(5), 1000);
+    expect(service.stats(2000).overdueBooks == 1, "overdue order: the first loan was not counted");
+    service.borrow("P1", isbnFor(6), 100);
+    service.giveBack("P1", isbnFor(6), 3000, fine);
+    expect(service.stats(3000).overdueBooks == 1, "overdue order: an uncounted return changed the count");
+    service.giveBack("P1", isbnFor(5), 3000, fine);
+    expect(service.stats(4000).overdueBooks == 0, "overdue order: the count did not return to 0");
+}
+
+// Cross-branch lookups fan out while desks circulate at every branch; each answer must
+// be a consistent count from that branch, and a branch never sees another's books
+static void testBranchLocate() {
+    BranchNetwork network;
+    const size_t branches = 6, rounds = 2000;
+    for (size_t i = 0; i < branches; ++i) {
+        network.addBranch(Librarian("Test", "T001"));
+        Library& library = network.getLibrary(i);
+        library.addBook("Shared", "Author", isbnFor(7));
+        library.addBook("Shared", "Author", isbnFor(7));
+        library.registerUser("Patron", "P1");
+    }
+    network.getLibrary(branches - 1).addBook("Local", "Author", isbnFor(8));
+    std::atomic<bool> done{false};
+    std::vector<std::thread> desks;
+    for (size_t i = 0; i < branches; ++i) {
+        desks.emplace_back([&, i] {
+            LibraryService& service = network.getService(i);
+            int64_t fine = 0;
+            for (size_t round = 0; round < rounds; ++round) {
+                service.borrow("P1", isbnFor(7), 1000);
+                service.giveBack("P1", isbnFor(7), 1000, fine);
+            }
+        });
+    }
+    std::thread lookups([&] {
+        while (!done) {
+            std::vector<BranchNetwork::Holding> found = network.locate(isbnFor(7));
+            bool consistent = found.size() == branches;
+            for (size_t i = 0; i < found.size(); ++i) {
+                consistent = consistent && found[i].branch == i && found[i].copies == 2 &&
+                             found[i].available >= 1 && found[i].available <= 2;
+            }
+            expect(consistent, "branches: a lookup saw an inconsistent holding");
+        }
+    });
+    for (std::thread& desk : desks) {
+        desk.join();
+    }
+    done = true;
+    lookups.join();
+    std::vector<BranchNetwork::Holding> local = network.locate(isbnFor(8));
+    expect(local.size() == 1 && local[0].branch == branches - 1, "branches: a local title was found elsewhere");
+    expect(network.getLibrary(0).getUsers().find("P1")->getBorrowedBooks().empty(),
+           "branches: a loan was left open");
+}
+
+// Import validation split over several threads must keep exactly what a serial pass
+// keeps: the first valid record of each ISBN not already held, in file order
+static void testCatalogValidation() {
+    Inventory inventory;
+    Librarian librarian("Test", "T001");
+    librarian.addBook(inventory, "Held", "Author", isbnFor(3));
+    const size_t count = 50000;
+    std::vector<BookRecord> records(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t book = i % 7 == 0 ? i / 3 : i;  // Every seventh row repeats an ISBN
+        records[i] = BookRecord{"  Title \t " + std::to_string(i) + " ", "Author", isbnFor(book)};
+    }
+    records[10].ISBN = "9780306406158";  // Bad checksum
+    records[11].title = " \t ";
+
+    std::vector<BookRecord> expected;
+    std::vector<bool> seen(count);
+    seen[3] = true;
+    size_t invalid = 0, duplicates = 0, held = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t book = i % 7 == 0 ? i / 3 : i;
+        if (i == 10 || i == 11) {
+            ++invalid;
+        } else if (book == 3) {
+            ++held;
+        } else if (seen[book]) {
+            ++duplicates;
+        } else {
+            seen[book] = true;
+            expected.push_back(BookRecord{"Title " + std::to_string(i), "Author", isbnFor(book)});
+        }
+    }
+
+    CatalogValidator::Result result = CatalogValidator::validate(records, inventory, 4);
+    bool same = records.size() == expected.size();
+    for (size_t i = 0; same && i < records.size(); ++i) {
+        same = records[i].title == expected[i].title && records[i].ISBN == expected[i].ISBN;
+    }
+    expect(result.threads == 4, "validation: the records were not split over 4 threads");
+    expect(same, "validation: kept records differ from a serial pass");
+    expect(result.invalid == invalid && result.duplicates == duplicates && result.held == held,
+           "validation: rejected counts differ from a serial pass");
+}
+
+// A snapshot whose loans do not cover its checked-out books, or with a negative balance,
+// describes a state the live API cannot reach, and must be refused
+static void testSnapshotConsistency() {
+    Library library(Librarian("Test", "T001"));
+    library.addBook("Lent", "Author", isbnFor(9));
+    library.registerUser("Patron", "P1");
+    library.borrow(0, library.getInventory().find(isbnFor(9)), 1000);
+    const std::string path = "service_test_snapshot.snap";
+    expect(Snapshot::save(path, library.getInventory(), library.getUsers(), 0), "snapshot: save failed");
+    std::string image;
+    {
+        std::ifstream in(path, std::ios::binary);
+        image.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    uint64_t usersOffset;
+    std::memcpy(&usersOffset, image.data() + 56, sizeof(usersOffset));  // Header::usersOffset
+
+    auto loads = [&](size_t at, const void* value, size_t size) {
+        std::string patched = image;
+        std::memcpy(&patched[at], value, size);
+        std::ofstream(path, std::ios::binary).write(patched.data(), static_cast<std::streamsize>(patched.size()));
+        Inventory inventory;
+        UserDirectory users;
+        uint64_t sequence = 0;
+        return Snapshot::load(path, inventory, users, sequence);
+    };
+    uint32_t noLoans = 0;
+    int64_t negative = -1, zero = 0;
+    expect(loads(usersOffset + 16, &zero, sizeof(zero)), "snapshot: a consistent image was refused");
+    expect(!loads(usersOffset + 32, &noLoans, sizeof(noLoans)), "snapshot: a checked-out book without a loan loaded");
+    expect(!loads(usersOffset + 16, &negative, sizeof(negative)), "snapshot: a negative fine loaded");
+    std::remove(path.c_str());
+}
+
+// A log record removing a copy that is on loan (a corrupt or reordered log) must be
+// rejected on replay, not leave the borrower with a dangling loan
+static void testReplayRemoveLoaned() {
+    const std::string path = "service_test_replay.log";
+    std::remove(path.c_str());
+    uint32_t handle;
+    {
+        Library library(Librarian("Test", "T001"));
+        library.openLog(path, std::chrono::milliseconds(0));
+        library.addBook("Lent", "Author", isbnFor(10));
+        library.registerUser("Patron", "P1");
+        Book* book = library.getInventory().find(isbnFor(10));
+        handle = book->getHandle().getValue();
+        library.borrow(0, book, 1000);
+    }
+    {
+        OpLog log;
+        log.open(path, std::chrono::milliseconds(0));
+        log.setSequence(100);
+        log.append(OpLog::Op::RemoveBook, 0, handle, 0, 0);
+    }
+    Library replayed(Librarian("Test", "T001"));
+    replayed.recover("", path);
+    const Book* book = replayed.getInventory().get(BookHandle::fromValue(handle));
+    expect(book != nullptr && replayed.getUsers()[0].getBorrowedBooks().size() == 1,
+           "replay: a logged removal took a book that is on loan");
+    std::remove(path.c_str());
+}
+
+// While one desk is stuck inside a return that holds its shards, desks whose books and
+// patrons hash to other shards must still finish. A process-wide lock on the
+// borrow/return path (log sequence, overdue heap) would leave them waiting here
+static void testShardIndependence() {
+    const size_t Shards = 64;  // LibraryService::ShardCount
+    auto userShard = [](const std::string& userID) { return HashIndex::hashString(userID) % Shards; };
+    auto bookShard = [](const std::string& ISBN) { return Isbn::hash(Isbn::parse(ISBN)) % Shards; };
+    Library library(Librarian("Test", "T001"));
+    LibraryService service(library);
+    library.addBook("Held", "Author", isbnFor(100));
+    library.registerUser("Holder", "H");
+    library.registerUser("Waiter", "W");
+    std::vector<size_t> held = {bookShard(isbnFor(100)), userShard("H"), userShard("W")};
+    auto unheld = [&held](size_t shard) { return std::find(held.begin(), held.end(), shard) == held.end(); };
+
+    // Two desks, each with a patron and a book on shards the stuck return does not hold
+    std::vector<std::string> deskUsers, deskBooks;
+    for (size_t i = 0; deskUsers.size() < 2; ++i) {
+        std::string userID = "D" + std::to_string(i);
+        if (unheld(userShard(userID))) {
+            deskUsers.push_back(userID);
+            library.registerUser("Desk", userID);
+        }
+    }
+    for (size_t i = 101; deskBooks.size() < 2; ++i) {
+        if (unheld(bookShard(isbnFor(i)))) {
+            deskBooks.push_back(isbnFor(i));
+            library.addBook("Desk Book", "Author", isbnFor(i));
+        }
+    }
+
+    std::mutex gate;
+    std::condition_variable changed;
+    bool entered = false, released = false;
+    library.setHoldListener([&](const Library::HoldNotice&) {
+        std::unique_lock<std::mutex> guard(gate);
+        entered = true;
+        changed.notify_all();
+        changed.wait(guard, [&] { return released; });
+    });
+    service.borrow("H", isbnFor(100), 1000);
+    service.placeHold("W", isbnFor(100), 1000);
+    std::thread stuck([&] {
+        int64_t fine = 0;
+        service.giveBack("H", isbnFor(100), 1000, fine);
+    });
+    {
+        std::unique_lock<std::mutex> guard(gate);
+        changed.wait(guard, [&] { return entered; });
+    }
+
+    std::atomic<size_t> finished{0};
+    std::vector<std::thread> desks;
+    for (size_t t = 0; t < 2; ++t) {
+        desks.emplace_back([&, t] {
+            int64_t fine = 0;
+            for (size_t round = 0; round < 1000; ++round) {
+                service.borrow(deskUsers[t], deskBooks[t], 1000);
+                service.giveBack(deskUsers[t], deskBooks[t], 1000, fine);
+            }
+            ++finished;
+            std::lock_guard<std::mutex> guard(gate);
+            changed.notify_all();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> guard(gate);
+        changed.wait_for(guard, std::chrono::seconds(30), [&] { return finished == 2; });
+        expect(finished == 2, "shards: desks on other shards waited for a held shard");
+        released = true;
+        changed.notify_all();
+    }
+    stuck.join();
+    for (std::thread& desk : desks) {
+        desk.join();
+    }
+}
+
+int main() {
+    std::ostringstream discard;
+    std::streambuf* console = std::cout.rdbuf(discard.rdbuf());
+    testDoubleBorrow();
+    testForeignReturn();
+    testOverlappingStacks();
+    testCatalogViews();
+    testViewPaging();
+    testReborrowSameDue();
+    testHoldNoticeDelivery();
+    testLoanListSpill();
+    testOverdueCountOrder();
+    testBranchLocate();
+    testCatalogValidation();
+    testSnapshotConsistency();
+    testReplayRemoveLoaned();
+    testShardIndependence();
+    std::cout.rdbuf(console);
+    std::fprintf(stderr, "service_test: %s\n", failures == 0 ? "all passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
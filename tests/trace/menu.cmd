@@ -0,0 +1,4 @@
+ADD 9780306406157 Menu Title|Menu Author
+REGISTER R1 Reader
+LIST available 0 20
+PAY R1 2.50
@@ -0,0 +1,22 @@
+# Every kind of logged mutation; the last line's record is the one torn off
+ADD 9780306406157 Logged Title|Author
+ADD 9780306406157 Logged Title|Author
+ADD 9780804429573 Second Title|Author
+ADD 9781861972712 Third Title|Author
+ADD 9780131103627 Removed Title|Author
+REGISTER U1 First Reader
+REGISTER U2 Second Reader
+REGISTER U3 Third Reader
+CLASS U2 1
+BORROW U1 9780306406157
+BORROW U2 9780306406157
+BORROW U3 9780306406157
+CHECKOUT U1 9780804429573 9781861972712
+RETURN U1 9780306406157
+CHECKIN U1 9781861972712
+PAY U1 0
+REMOVE 9780131103627
+ADD 9780131103627 Weeded Title|Author
+ADD 9780131103627 Weeded Title|Author
+WEED 9780131103627
+REGISTER U4 Torn Off
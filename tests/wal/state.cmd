@@ -0,0 +1,4 @@
+LIST
+INFO U1
+INFO U2
+INFO U3